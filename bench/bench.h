@@ -0,0 +1,68 @@
+#ifndef WSS_BENCH_H
+#define WSS_BENCH_H
+
+#include <cstdint>
+#include <chrono>
+
+namespace wss {
+namespace bench {
+
+/*
+	State:  what a benchmark function is handed
+
+	Rules:
+		1.  setup goes before start(), the timed loop runs getIterations() times then stop() is called
+		2.  setBytesProcessed / setItemsProcessed report what the timed loop did, bytes give a rate and items
+			(i.e. values encoded) make ns/op per item rather than per iteration
+		3.  the runner keeps raising the iteration count until one run takes at least the minimum time
+*/
+class State {
+public:
+	typedef std::chrono::steady_clock Clock;
+public:
+	explicit State(uint64_t iterations) : Iterations(iterations), Bytes(0), Items(0), Started(), Elapsed(0) {}
+	uint64_t getIterations() const {return Iterations;}
+	void start() {Started = Clock::now();}
+	void stop() {Elapsed = std::chrono::duration<double>(Clock::now()-Started).count();}
+	void setBytesProcessed(uint64_t bytes) {Bytes = bytes;}
+	void setItemsProcessed(uint64_t items) {Items = items;}
+	uint64_t getBytesProcessed() const {return Bytes;}
+	uint64_t getItemsProcessed() const {return Items;}
+	//seconds between start() and stop()
+	double getElapsed() const {return Elapsed;}
+private:
+	uint64_t Iterations;
+	uint64_t Bytes;
+	uint64_t Items;
+	Clock::time_point Started;
+	double Elapsed;
+};
+
+typedef void (*BenchmarkFunction)(State &state);
+
+//adds a benchmark to the list bench_main runs, use through WSS_BENCHMARK
+class Registration {
+public:
+	Registration(const char *name, BenchmarkFunction function);
+};
+
+//keeps the compiler from throwing away a result the timed loop computed
+template<typename T>
+inline void doNotOptimize(const T &value) {
+#if defined(__GNUC__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const void *Sink;
+	Sink = &value;
+#endif
+}
+
+}
+}
+
+#define WSS_BENCH_CONCAT2(a,b) a##b
+#define WSS_BENCH_CONCAT(a,b) WSS_BENCH_CONCAT2(a,b)
+#define WSS_BENCHMARK(name, function) \
+	static wss::bench::Registration WSS_BENCH_CONCAT(wssBenchmark,__COUNTER__)(name, function)
+
+#endif
@@ -0,0 +1,163 @@
+#include "bench.h"
+#include "wsinit.h"
+#include "inet/tcp.h"
+#include "inet/channel.h"
+#include "buffer/shared_buffer.h"
+#include <vector>
+#include <cstdio>
+
+using namespace wss;
+using namespace wss::bench;
+
+/*
+	ComChannel send out / buffer in over a connected loopback pair, both ends on this thread.  The channel is the
+	server side of the pair (TCPComChannel only wraps sockets ListenerSocket accepted), the client socket is
+	drained or fed as fast as the channel moves bytes
+*/
+namespace {
+	const uint32_t DRAIN_SIZE = 256*1024;
+
+	void initOnce() {
+		static bool Done = false;
+		if(!Done) {
+			std::shared_ptr<spdlog::logger> logger = spdlog::default_logger();
+			logger->set_level(spdlog::level::warn);
+			WSInit::init(logger);
+			Done = true;
+		}
+	}
+
+	class Loopback {
+	public:
+		Loopback() : Listener(ListenerSocket::create()), Client(TCPClientSocket::create()), Channel(0), Scratch(DRAIN_SIZE) {}
+		~Loopback() {
+			delete Channel;
+			Client.closeSocket();
+			Listener.closeSocket();
+		}
+		//listen on an ephemeral port, connect to it and wrap the accepted end in a channel
+		bool open() {
+			initOnce();
+			InetAddressV4 local("127.0.0.1");
+			if(!Listener.listen(local,PortNum(0),16,false)) {
+				return false;
+			}
+			InetAddressV4 addr;
+			PortNum port;
+			if(!Listener.getLocalAddress(addr,port) || !Client.connect(local,short(port))) {
+				return false;
+			}
+			TCPServerSocket *ss = 0;
+			for(int i=0;i<1000 && !ss;i++) {
+				Listener.getNewConnection(ss);
+			}
+			if(!ss) {
+				return false;
+			}
+			Client.setNonBlocking();
+			Channel = new TCPComChannel(ss);
+			return true;
+		}
+		//read whatever the client socket has, returns bytes read
+		uint64_t drainClient() {
+			uint64_t total = 0;
+			int n = 0;
+			while((n = Client.receive(&Scratch[0],DRAIN_SIZE))>0) {
+				total += n;
+			}
+			return total;
+		}
+		ListenerSocket Listener;
+		TCPClientSocket Client;
+		TCPComChannel *Channel;
+		std::vector<char> Scratch;
+	};
+
+	//bufferOut a SIZE byte message then send until the client has it all
+	template<uint32_t SIZE>
+	void sendOut(State &state) {
+		Loopback lb;
+		if(!lb.open()) {
+			printf("loopback connection failed\n");
+			return;
+		}
+		std::vector<char> msg(SIZE,'s');
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			lb.Channel->bufferOut(&msg[0],SIZE);
+			uint64_t received = 0;
+			while(received<SIZE) {
+				if(lb.Channel->hasDataToSend()) {
+					lb.Channel->sendData();
+				}
+				received += lb.drainClient();
+			}
+		}
+		state.stop();
+		state.setBytesProcessed(state.getIterations()*SIZE);
+	}
+
+	//same as sendOut but the out buffer holds a ref on one shared payload rather than a copy
+	template<uint32_t SIZE>
+	void sendOutShared(State &state) {
+		Loopback lb;
+		if(!lb.open()) {
+			printf("loopback connection failed\n");
+			return;
+		}
+		std::vector<char> msg(SIZE,'s');
+		SharedBuffer payload(&msg[0],SIZE);
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			lb.Channel->bufferOut(payload);
+			uint64_t received = 0;
+			while(received<SIZE) {
+				if(lb.Channel->hasDataToSend()) {
+					lb.Channel->sendData();
+				}
+				received += lb.drainClient();
+			}
+		}
+		state.stop();
+		state.setBytesProcessed(state.getIterations()*SIZE);
+	}
+
+	//client sends SIZE bytes, the channel buffers them in and the application removes them
+	template<uint32_t SIZE>
+	void bufferIn(State &state) {
+		Loopback lb;
+		if(!lb.open()) {
+			printf("loopback connection failed\n");
+			return;
+		}
+		std::vector<char> msg(SIZE,'r');
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			uint32_t sent = 0;
+			uint32_t buffered = 0;
+			while(buffered<SIZE) {
+				if(sent<SIZE) {
+					int n = lb.Client.send(&msg[sent],SIZE-sent);
+					if(n>0) {
+						sent += n;
+					}
+				}
+				lb.Channel->bufferIn();
+				uint32_t len = lb.Channel->getCommandBufferLength();
+				lb.Channel->removeFromBuffer(len);
+				buffered += len;
+			}
+		}
+		state.stop();
+		state.setBytesProcessed(state.getIterations()*SIZE);
+	}
+}
+
+WSS_BENCHMARK("ComChannel/send_out/256", sendOut<256>);
+WSS_BENCHMARK("ComChannel/send_out/16384", sendOut<16384>);
+WSS_BENCHMARK("ComChannel/send_out/262144", sendOut<262144>);
+WSS_BENCHMARK("ComChannel/send_out_shared/16384", sendOutShared<16384>);
+WSS_BENCHMARK("ComChannel/send_out_shared/262144", sendOutShared<262144>);
+WSS_BENCHMARK("ComChannel/buffer_in/256", bufferIn<256>);
+WSS_BENCHMARK("ComChannel/buffer_in/16384", bufferIn<16384>);
+WSS_BENCHMARK("ComChannel/buffer_in/262144", bufferIn<262144>);
@@ -0,0 +1,97 @@
+#include "bench.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace wss::bench;
+
+namespace {
+	struct Entry {
+		const char *Name;
+		BenchmarkFunction Function;
+	};
+
+	std::vector<Entry> &getEntries() {
+		static std::vector<Entry> Entries;
+		return Entries;
+	}
+
+	const uint64_t MAX_ITERATIONS = 1000000000;
+
+	void usage(const char *prog) {
+		printf("usage: %s [--filter=substring] [--min-time=seconds] [--list]\n", prog);
+	}
+}
+
+Registration::Registration(const char *name, BenchmarkFunction function) {
+	Entry e;
+	e.Name = name;
+	e.Function = function;
+	getEntries().push_back(e);
+}
+
+/**********************************************************************************************
+* run -- run one benchmark with more iterations each time until a run takes at least minTime
+*
+*	The next count is scaled from the last run's time (at most 10x) so a fast function only
+*	takes a few runs to get there.
+*
+*********************************************************************************************/
+static void run(const Entry &e, double minTime) {
+	uint64_t iterations = 1;
+	for(;;) {
+		State state(iterations);
+		e.Function(state);
+		double elapsed = state.getElapsed();
+		if(elapsed>=minTime || iterations>=MAX_ITERATIONS) {
+			uint64_t ops = state.getItemsProcessed() ? state.getItemsProcessed() : iterations;
+			double nsPerOp = elapsed*1e9/double(ops);
+			if(state.getBytesProcessed()) {
+				printf("%-52s %12llu %12.2f %12.1f\n", e.Name, (unsigned long long)ops, nsPerOp, double(state.getBytesProcessed())/elapsed/1e6);
+			} else {
+				printf("%-52s %12llu %12.2f %12s\n", e.Name, (unsigned long long)ops, nsPerOp, "-");
+			}
+			fflush(stdout);
+			return;
+		}
+		double scale = elapsed>0 ? (minTime*1.4)/elapsed : 10.0;
+		scale = scale>10.0 ? 10.0 : (scale<2.0 ? 2.0 : scale);
+		iterations = uint64_t(double(iterations)*scale);
+		iterations = iterations>MAX_ITERATIONS ? MAX_ITERATIONS : iterations;
+	}
+}
+
+int main(int argc, char **argv) {
+	std::string filter;
+	double minTime = 0.25;
+	bool list = false;
+	for(int i=1;i<argc;i++) {
+		if(strncmp(argv[i],"--filter=",9)==0) {
+			filter = argv[i]+9;
+		} else if(strncmp(argv[i],"--min-time=",11)==0) {
+			minTime = atof(argv[i]+11);
+		} else if(strcmp(argv[i],"--list")==0) {
+			list = true;
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(!list) {
+		printf("%-52s %12s %12s %12s\n", "benchmark", "ops", "ns/op", "MB/s");
+	}
+	const std::vector<Entry> &entries = getEntries();
+	for(size_t i=0;i<entries.size();i++) {
+		if(!filter.empty() && strstr(entries[i].Name,filter.c_str())==0) {
+			continue;
+		}
+		if(list) {
+			printf("%s\n", entries[i].Name);
+		} else {
+			run(entries[i], minTime);
+		}
+	}
+	return 0;
+}
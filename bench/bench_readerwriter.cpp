@@ -0,0 +1,299 @@
+#include "bench.h"
+#include "io/readerwriter.h"
+#include <vector>
+#include <string>
+#include <thread>
+
+using namespace wss;
+using namespace wss::bench;
+
+/*
+	ReaderWriter fixed width and varint encode / decode on the default (segmented) stream, and line framing with
+	readUntilDelim / findDelim.  ns/op is per value or per line
+*/
+namespace {
+	const size_t VALUES = 64*1024;
+
+	//values spread over every varint length
+	template<typename T>
+	std::vector<T> makeValues() {
+		std::vector<T> vals(VALUES);
+		uint64_t x = 88172645463325252ULL;
+		for(size_t i=0;i<VALUES;i++) {
+			x ^= x<<13;
+			x ^= x>>7;
+			x ^= x<<17;
+			vals[i] = T(x)>>(x%(sizeof(T)*8));
+		}
+		return vals;
+	}
+
+	void fixed32Write(State &state) {
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			for(size_t v=0;v<1024;v++) {
+				rw.writeFixed32(uint32_t(v));
+			}
+			if(rw.size()>=1024*1024) {
+				rw.consume(rw.size());
+			}
+		}
+		state.stop();
+		state.setItemsProcessed(state.getIterations()*1024);
+		state.setBytesProcessed(state.getIterations()*1024*sizeof(uint32_t));
+	}
+
+	void fixed32Read(State &state) {
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		for(size_t v=0;v<VALUES;v++) {
+			rw.writeFixed32(uint32_t(v));
+		}
+		uint32_t val = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			for(size_t v=0;v<1024;v++) {
+				rw.readFixed32(val);
+			}
+			if(rw.unreadSize()<1024*sizeof(uint32_t)) {
+				rw.seekRead(0,ReaderWriter::BEGIN);
+			}
+		}
+		state.stop();
+		doNotOptimize(val);
+		state.setItemsProcessed(state.getIterations()*1024);
+		state.setBytesProcessed(state.getIterations()*1024*sizeof(uint32_t));
+	}
+
+	void fixed64Write(State &state) {
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			for(size_t v=0;v<1024;v++) {
+				rw.writeFixed64(uint64_t(v));
+			}
+			if(rw.size()>=1024*1024) {
+				rw.consume(rw.size());
+			}
+		}
+		state.stop();
+		state.setItemsProcessed(state.getIterations()*1024);
+		state.setBytesProcessed(state.getIterations()*1024*sizeof(uint64_t));
+	}
+
+	void fixed64Read(State &state) {
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		for(size_t v=0;v<VALUES;v++) {
+			rw.writeFixed64(uint64_t(v));
+		}
+		uint64_t val = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			for(size_t v=0;v<1024;v++) {
+				rw.readFixed64(val);
+			}
+			if(rw.unreadSize()<1024*sizeof(uint64_t)) {
+				rw.seekRead(0,ReaderWriter::BEGIN);
+			}
+		}
+		state.stop();
+		doNotOptimize(val);
+		state.setItemsProcessed(state.getIterations()*1024);
+		state.setBytesProcessed(state.getIterations()*1024*sizeof(uint64_t));
+	}
+
+	void varUInt32Write(State &state) {
+		std::vector<uint32_t> vals = makeValues<uint32_t>();
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		size_t v = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			rw.writeVarUInt32(vals[v]);
+			v = (v+1)&(VALUES-1);
+			if(v==0) {
+				rw.consume(rw.size());
+			}
+		}
+		state.stop();
+	}
+
+	void varUInt32Read(State &state) {
+		std::vector<uint32_t> vals = makeValues<uint32_t>();
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		rw.writeVarUInt32Array(&vals[0],VALUES);
+		uint32_t val = 0;
+		size_t v = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			rw.readVarUInt32(val);
+			v = (v+1)&(VALUES-1);
+			if(v==0) {
+				rw.seekRead(0,ReaderWriter::BEGIN);
+			}
+		}
+		state.stop();
+		doNotOptimize(val);
+	}
+
+	void varUInt64Write(State &state) {
+		std::vector<uint64_t> vals = makeValues<uint64_t>();
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		size_t v = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			rw.writeVarUInt64(vals[v]);
+			v = (v+1)&(VALUES-1);
+			if(v==0) {
+				rw.consume(rw.size());
+			}
+		}
+		state.stop();
+	}
+
+	void varUInt64Read(State &state) {
+		std::vector<uint64_t> vals = makeValues<uint64_t>();
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		rw.writeVarUInt64Array(&vals[0],VALUES);
+		uint64_t val = 0;
+		size_t v = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			rw.readVarUInt64(val);
+			v = (v+1)&(VALUES-1);
+			if(v==0) {
+				rw.seekRead(0,ReaderWriter::BEGIN);
+			}
+		}
+		state.stop();
+		doNotOptimize(val);
+	}
+
+	void varUInt32ArrayWrite(State &state) {
+		std::vector<uint32_t> vals = makeValues<uint32_t>();
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			rw.writeVarUInt32Array(&vals[0],VALUES);
+			rw.consume(rw.size());
+		}
+		state.stop();
+		state.setItemsProcessed(state.getIterations()*VALUES);
+	}
+
+	void varUInt32ArrayRead(State &state) {
+		std::vector<uint32_t> vals = makeValues<uint32_t>();
+		std::vector<uint32_t> out(VALUES);
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		rw.writeVarUInt32Array(&vals[0],VALUES);
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			rw.seekRead(0,ReaderWriter::BEGIN);
+			rw.readVarUInt32Array(&out[0],VALUES);
+		}
+		state.stop();
+		doNotOptimize(out[VALUES-1]);
+		state.setItemsProcessed(state.getIterations()*VALUES);
+	}
+
+	//newline terminated lines of 20 to 140 bytes, about a megabyte of them
+	size_t makeLines(ReaderWriter &rw) {
+		std::string line;
+		size_t lines = 0;
+		while(rw.size()<1024*1024) {
+			line.assign(20+(lines*37)%120,char('a'+lines%26));
+			line.push_back('\n');
+			rw.write(line.data(),line.size());
+			++lines;
+		}
+		return lines;
+	}
+
+	//copy each line out with readUntilDelim then step over the delim
+	void readUntilDelimFraming(State &state) {
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		makeLines(rw);
+		char line[256];
+		bool hit = false;
+		uint64_t bytes = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			if(rw.unreadSize()==0) {
+				rw.seekRead(0,ReaderWriter::BEGIN);
+			}
+			size_t len = rw.readUntilDelim(line,sizeof(line),'\n',hit);
+			rw.seekRead(1,ReaderWriter::CUR);
+			bytes += len+1;
+		}
+		state.stop();
+		doNotOptimize(line[0]);
+		state.setBytesProcessed(bytes);
+	}
+
+	//find the end of each line without copying, what a zero copy framer does before handing out raw()
+	void findDelimFraming(State &state) {
+		ReaderWriter rw(ReaderWriter::Create_Default_Interface());
+		makeLines(rw);
+		size_t pos = 0;
+		uint64_t bytes = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			size_t end = rw.findDelim(pos,'\n');
+			bytes += end+1-pos;
+			pos = end+1<rw.size() ? end+1 : 0;
+		}
+		state.stop();
+		state.setBytesProcessed(bytes);
+	}
+
+	//4K chunks handed from a writer thread to this one through the lock free queue, read in place with raw
+	void spscHandoff(State &state) {
+		IReaderWriter *producer = 0;
+		IReaderWriter *consumer = 0;
+		ReaderWriter::Create_SPSC_Interfaces(producer,consumer,1024*1024);
+		const uint64_t total = state.getIterations()*4096;
+		std::vector<uint8_t> chunk(4096,'s');
+		ReaderWriter in(consumer);
+		state.start();
+		std::thread writer([producer,total,&chunk]() {
+			ReaderWriter out(producer);
+			uint64_t sent = 0;
+			while(sent<total) {
+				size_t n = out.write(chunk.data(),chunk.size());
+				if(n==0) {
+					std::this_thread::yield();
+				}
+				sent += n;
+			}
+		});
+		uint64_t received = 0;
+		uint64_t sum = 0;
+		while(received<total) {
+			size_t len = 0;
+			const uint8_t *p = static_cast<const uint8_t*>(in.raw(0,len));
+			if(!p || len==0) {
+				std::this_thread::yield();
+				continue;
+			}
+			sum += p[len-1];
+			received += in.consume(len);
+		}
+		writer.join();
+		state.stop();
+		doNotOptimize(sum);
+		state.setBytesProcessed(total);
+	}
+}
+
+WSS_BENCHMARK("ReaderWriter/fixed32/write", fixed32Write);
+WSS_BENCHMARK("ReaderWriter/fixed32/read", fixed32Read);
+WSS_BENCHMARK("ReaderWriter/fixed64/write", fixed64Write);
+WSS_BENCHMARK("ReaderWriter/fixed64/read", fixed64Read);
+WSS_BENCHMARK("ReaderWriter/varuint32/write", varUInt32Write);
+WSS_BENCHMARK("ReaderWriter/varuint32/read", varUInt32Read);
+WSS_BENCHMARK("ReaderWriter/varuint64/write", varUInt64Write);
+WSS_BENCHMARK("ReaderWriter/varuint64/read", varUInt64Read);
+WSS_BENCHMARK("ReaderWriter/varuint32_array/write", varUInt32ArrayWrite);
+WSS_BENCHMARK("ReaderWriter/varuint32_array/read", varUInt32ArrayRead);
+WSS_BENCHMARK("ReaderWriter/framing/read_until_delim", readUntilDelimFraming);
+WSS_BENCHMARK("ReaderWriter/framing/find_delim", findDelimFraming);
+WSS_BENCHMARK("ReaderWriter/spsc/handoff_4k", spscHandoff);
@@ -0,0 +1,199 @@
+#include "bench.h"
+#include "buffer/segmented_buffer.h"
+#include "buffer/pooled_block_allocator.h"
+#include "buffer/arena_block_allocator.h"
+#include <vector>
+
+using namespace wss;
+using namespace wss::bench;
+
+/*
+	SegmentedBuffer write / read / erase / raw across block sizes.  Each config is a buffer type and the size
+	policy it is built with, every benchmark runs a steady state buffer of about WORKING_SET bytes
+*/
+namespace {
+	const uint64_t WORKING_SET = 1024*1024;
+
+	struct Blocks64 {
+		typedef SegmentedBuffer<BlockBufferAllocator<64> > Buffer;
+		static BlockSizePolicy policy() {return BlockSizePolicy();}
+	};
+	struct Blocks1024 {
+		typedef SegmentedBuffer<BlockBufferAllocator<1024> > Buffer;
+		static BlockSizePolicy policy() {return BlockSizePolicy();}
+	};
+	struct Pooled4000 {
+		typedef PooledSegmentedBuffer Buffer;
+		static BlockSizePolicy policy() {return BlockSizePolicy();}
+	};
+	struct Arena4000 {
+		typedef ArenaSegmentedBuffer Buffer;
+		static BlockSizePolicy policy() {return BlockSizePolicy();}
+	};
+	struct Pooled64K {
+		typedef PooledSegmentedBuffer Buffer;
+		static BlockSizePolicy policy() {return BlockSizePolicy::Fixed(BlockSizePolicy::PAGE_64K);}
+	};
+	struct Adaptive {
+		typedef PooledSegmentedBuffer Buffer;
+		static BlockSizePolicy policy() {return BlockSizePolicy::Adaptive(BlockSizePolicy::PAGE_4K,1024*1024);}
+	};
+
+	template<typename Config>
+	void fill(typename Config::Buffer &buf, uint64_t bytes) {
+		std::vector<uint8_t> chunk(4096,'x');
+		while(buf.Size()<bytes) {
+			buf.write(buf.Size(),&chunk[0],chunk.size());
+		}
+	}
+
+	//append CHUNK bytes, the buffer is drained from the front once it holds the working set
+	template<typename Config, uint32_t CHUNK>
+	void write(State &state) {
+		typename Config::Buffer buf(Config::policy());
+		std::vector<uint8_t> chunk(CHUNK,'w');
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			buf.write(buf.Size(),&chunk[0],CHUNK);
+			if(buf.Size()>=WORKING_SET) {
+				buf.consume(buf.Size());
+			}
+		}
+		state.stop();
+		state.setBytesProcessed(state.getIterations()*CHUNK);
+	}
+
+	//CHUNK bytes at a time from positions that walk the whole buffer
+	template<typename Config, uint32_t CHUNK>
+	void read(State &state) {
+		typename Config::Buffer buf(Config::policy());
+		fill<Config>(buf,WORKING_SET);
+		std::vector<uint8_t> out(CHUNK);
+		uint64_t pos = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			buf.read(pos,&out[0],CHUNK);
+			doNotOptimize(out[0]);
+			pos += CHUNK*7;
+			if(pos+CHUNK>buf.Size()) {
+				pos %= CHUNK;
+			}
+		}
+		state.stop();
+		state.setBytesProcessed(state.getIterations()*CHUNK);
+	}
+
+	//consume CHUNK from the front and append CHUNK, a channel's receive buffer
+	template<typename Config, uint32_t CHUNK>
+	void consume(State &state) {
+		typename Config::Buffer buf(Config::policy());
+		fill<Config>(buf,WORKING_SET);
+		std::vector<uint8_t> chunk(CHUNK,'c');
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			buf.consume(CHUNK);
+			buf.write(buf.Size(),&chunk[0],CHUNK);
+		}
+		state.stop();
+		state.setBytesProcessed(state.getIterations()*CHUNK);
+	}
+
+	//erase CHUNK from the middle and append CHUNK to keep the size
+	template<typename Config, uint32_t CHUNK>
+	void eraseMiddle(State &state) {
+		typename Config::Buffer buf(Config::policy());
+		fill<Config>(buf,WORKING_SET);
+		std::vector<uint8_t> chunk(CHUNK,'e');
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			buf.erase(buf.Size()/2+(i%CHUNK),CHUNK);
+			buf.write(buf.Size(),&chunk[0],CHUNK);
+		}
+		state.stop();
+		state.setBytesProcessed(state.getIterations()*CHUNK);
+	}
+
+	//every contiguous span of the buffer through raw, bytes are the whole buffer per iteration
+	template<typename Config>
+	void rawScan(State &state) {
+		typename Config::Buffer buf(Config::policy());
+		fill<Config>(buf,WORKING_SET);
+		uint64_t size = buf.Size();
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			uint64_t pos = 0;
+			uint32_t len = 0;
+			while(pos<size) {
+				const void *p = buf.raw(pos,len);
+				doNotOptimize(p);
+				pos += len;
+			}
+		}
+		state.stop();
+		state.setBytesProcessed(state.getIterations()*size);
+	}
+
+	//raw at scattered positions, the index lookup on its own
+	template<typename Config>
+	void rawLookup(State &state) {
+		typename Config::Buffer buf(Config::policy());
+		fill<Config>(buf,WORKING_SET);
+		uint64_t size = buf.Size();
+		uint64_t pos = 0;
+		uint32_t len = 0;
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			const void *p = buf.raw(pos,len);
+			doNotOptimize(p);
+			pos = (pos+104729)%size;
+		}
+		state.stop();
+	}
+
+	//move the working set to another buffer and back
+	template<typename Config>
+	void splice(State &state) {
+		typename Config::Buffer a(Config::policy()), b(Config::policy());
+		fill<Config>(a,WORKING_SET);
+		uint64_t size = a.Size();
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			a.splice(b,0,size);
+			b.splice(a,0,size);
+		}
+		state.stop();
+		state.setBytesProcessed(state.getIterations()*size*2);
+	}
+
+	//copy on write snapshot of the working set, dropped right away
+	template<typename Config>
+	void snapshot(State &state) {
+		typename Config::Buffer buf(Config::policy());
+		fill<Config>(buf,WORKING_SET);
+		state.start();
+		for(uint64_t i=0;i<state.getIterations();i++) {
+			typename Config::Buffer copy(buf);
+			doNotOptimize(copy.Size());
+		}
+		state.stop();
+	}
+}
+
+#define WSS_SEGMENTED_BENCHMARKS(config) \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/write/64", (write<config,64>)); \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/write/1500", (write<config,1500>)); \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/read/64", (read<config,64>)); \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/read/1500", (read<config,1500>)); \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/consume/1500", (consume<config,1500>)); \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/erase_middle/64", (eraseMiddle<config,64>)); \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/raw_scan", rawScan<config>); \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/raw_lookup", rawLookup<config>); \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/splice", splice<config>); \
+	WSS_BENCHMARK("SegmentedBuffer/" #config "/snapshot", snapshot<config>)
+
+WSS_SEGMENTED_BENCHMARKS(Blocks64);
+WSS_SEGMENTED_BENCHMARKS(Blocks1024);
+WSS_SEGMENTED_BENCHMARKS(Pooled4000);
+WSS_SEGMENTED_BENCHMARKS(Arena4000);
+WSS_SEGMENTED_BENCHMARKS(Pooled64K);
+WSS_SEGMENTED_BENCHMARKS(Adaptive);
@@ -0,0 +1,156 @@
+#include "arena_block_allocator.h"
+
+#ifdef WSS_LINUX
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace wss;
+
+namespace {
+	const size_t CHUNK_ALIGNMENT = 64;
+	//linux mempolicy mode, from linux/mempolicy.h
+	const int WSS_MPOL_PREFERRED = 1;
+}
+
+std::atomic<int> BlockArena::Mode(BlockArena::HUGE_PAGES_TRANSPARENT);
+
+BlockArena::BlockArena(size_t chunkSize, uint32_t node) : ChunkSize((chunkSize+CHUNK_ALIGNMENT-1) & ~(CHUNK_ALIGNMENT-1)), Node(node),
+	Lock(), FreeList(0), Next(0), End(0), Regions(), ArenaStats() {
+}
+
+BlockArena::~BlockArena() {
+#ifdef WSS_LINUX
+	for(size_t i=0;i<Regions.size();i++) {
+		munmap(Regions[i].Base,Regions[i].Size);
+	}
+#else
+	for(size_t i=0;i<Regions.size();i++) {
+		::operator delete(Regions[i].Base);
+	}
+#endif
+}
+
+/**********************************************************************************************
+* BlockArena::allocate -- hand out a chunk, free list first then carve from the current region
+*
+* Returns: chunk of getChunkSize() bytes or null if a new region was needed and could not be mapped
+*
+*********************************************************************************************/
+void *BlockArena::allocate() {
+	std::lock_guard<std::mutex> guard(Lock);
+	if(FreeList) {
+		FreeNode *n = FreeList;
+		FreeList = n->Next;
+		--ArenaStats.FreeChunks;
+		return n;
+	}
+	if(size_t(End-Next)<ChunkSize && !mapRegion()) {
+		return 0;
+	}
+	void *chunk = Next;
+	Next += ChunkSize;
+	return chunk;
+}
+
+void BlockArena::deallocate(void *chunk) {
+	std::lock_guard<std::mutex> guard(Lock);
+	FreeNode *n = static_cast<FreeNode*>(chunk);
+	n->Next = FreeList;
+	FreeList = n;
+	++ArenaStats.FreeChunks;
+}
+
+BlockArena::Stats BlockArena::getStats() const {
+	std::lock_guard<std::mutex> guard(Lock);
+	return ArenaStats;
+}
+
+void BlockArena::setHugePageMode(HugePageMode mode) {
+	Mode.store(mode,std::memory_order_relaxed);
+}
+
+BlockArena::HugePageMode BlockArena::getHugePageMode() {
+	return HugePageMode(Mode.load(std::memory_order_relaxed));
+}
+
+/**********************************************************************************************
+* BlockArena::currentNode -- NUMA node of the cpu the calling thread is on
+*
+*********************************************************************************************/
+uint32_t BlockArena::currentNode() {
+#if defined(WSS_LINUX) && defined(SYS_getcpu)
+	unsigned cpu = 0;
+	unsigned node = 0;
+	if(syscall(SYS_getcpu,&cpu,&node,0)==0 && node<MAX_NODES) {
+		return node;
+	}
+#endif
+	return 0;
+}
+
+/**********************************************************************************************
+* BlockArena::mapRegion -- map a new region and make it the one chunks are carved from
+*
+*	Huge pages are tried in order MAP_HUGETLB (only in HUGE_PAGES_TLB mode, fails if none are
+*	reserved), then plain pages with MADV_HUGEPAGE (THP may or may not back them).  The node
+*	binding is MPOL_PREFERRED so a full node spills over rather than failing the allocation.
+*	Whatever is left over at the end of the old region is wasted, it is less than one chunk.
+*
+* Returns: false if no memory could be mapped
+*
+*********************************************************************************************/
+bool BlockArena::mapRegion() {
+	size_t size = REGION_SIZE;
+	if(ChunkSize>size) {
+		size = (ChunkSize+REGION_SIZE-1)/REGION_SIZE*REGION_SIZE;
+	}
+	HugePageMode mode = getHugePageMode();
+	void *mem = 0;
+#ifdef WSS_LINUX
+	bool hugeTLB = false;
+#ifdef MAP_HUGETLB
+	if(mode==HUGE_PAGES_TLB) {
+		mem = mmap(0,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+		hugeTLB = mem!=MAP_FAILED;
+	}
+#endif
+	if(!hugeTLB) {
+		mem = mmap(0,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if(mem==MAP_FAILED) {
+			return false;
+		}
+#ifdef MADV_HUGEPAGE
+		if(mode!=HUGE_PAGES_OFF) {
+			madvise(mem,size,MADV_HUGEPAGE);
+		}
+#endif
+	}
+#ifdef SYS_mbind
+	unsigned long nodeMask[MAX_NODES/(8*sizeof(unsigned long))] = {0};
+	nodeMask[Node/(8*sizeof(unsigned long))] = 1UL << (Node%(8*sizeof(unsigned long)));
+	if(syscall(SYS_mbind,mem,size,WSS_MPOL_PREFERRED,nodeMask,MAX_NODES+1,0)==0) {
+		++ArenaStats.BoundRegions;
+	}
+#endif
+	if(hugeTLB) {
+		++ArenaStats.HugeTLBRegions;
+	}
+#else
+	(void)mode;
+	mem = ::operator new(size,std::nothrow);
+	if(!mem) {
+		return false;
+	}
+#endif
+	Region r;
+	r.Base = mem;
+	r.Size = size;
+	Regions.push_back(r);
+	++ArenaStats.Regions;
+	ArenaStats.BytesMapped += size;
+	Next = static_cast<uint8_t*>(mem);
+	End = Next+size;
+	return true;
+}
@@ -0,0 +1,213 @@
+#ifndef WSS_ARENA_BLOCK_ALLOCATOR_H
+#define WSS_ARENA_BLOCK_ALLOCATOR_H
+
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include "segmented_buffer.h"
+
+namespace wss {
+
+/*
+	BlockArena:  fixed size chunks carved out of large mapped regions that all live on one NUMA node
+
+	Rules:
+		1.  regions are REGION_SIZE bytes, mapped with MAP_HUGETLB when the huge page mode is HUGE_PAGES_TLB and the
+			system has huge pages reserved, otherwise mapped normally and (HUGE_PAGES_TRANSPARENT) advised for THP
+		2.  a region is bound to the arena's node (preferred, not strict) before it is touched, so pages are placed
+			there on first touch.  If the kernel has no NUMA support the region is used as is
+		3.  regions are only unmapped when the arena is destroyed, freed chunks go on the arena's free list
+		4.  every call takes the arena's lock, ArenaBlockBufferAllocator keeps a lock free per thread cache in front
+*/
+class BlockArena {
+public:
+	enum HugePageMode {
+		HUGE_PAGES_OFF,
+		HUGE_PAGES_TRANSPARENT,
+		HUGE_PAGES_TLB
+	};
+	static const size_t REGION_SIZE = 32*1024*1024;
+	static const uint32_t MAX_NODES = 64;
+	struct Stats {
+		uint64_t Regions;			//regions mapped
+		uint64_t HugeTLBRegions;	//regions backed by MAP_HUGETLB pages
+		uint64_t BoundRegions;		//regions the kernel accepted the node binding for
+		uint64_t BytesMapped;
+		uint64_t FreeChunks;		//chunks on the arena free list (not counting thread caches)
+		Stats() : Regions(0), HugeTLBRegions(0), BoundRegions(0), BytesMapped(0), FreeChunks(0) {}
+	};
+public:
+	//chunkSize is rounded up to a multiple of 64 bytes so chunks don't share cache lines
+	BlockArena(size_t chunkSize, uint32_t node);
+	~BlockArena();
+	//null if no region could be mapped
+	void *allocate();
+	void deallocate(void *chunk);
+	uint32_t getNode() const {return Node;}
+	size_t getChunkSize() const {return ChunkSize;}
+	Stats getStats() const;
+	//applies to regions mapped from now on, by any arena
+	static void setHugePageMode(HugePageMode mode);
+	static HugePageMode getHugePageMode();
+	//NUMA node the calling thread is running on, 0 if that can't be found
+	static uint32_t currentNode();
+private:
+	struct FreeNode {
+		FreeNode *Next;
+	};
+	struct Region {
+		void *Base;
+		size_t Size;
+	};
+	bool mapRegion();
+	size_t ChunkSize;
+	uint32_t Node;
+	mutable std::mutex Lock;
+	FreeNode *FreeList;
+	uint8_t *Next;
+	uint8_t *End;
+	std::vector<Region> Regions;
+	Stats ArenaStats;
+	static std::atomic<int> Mode;
+private:
+	SET_NO_COPY(BlockArena);
+};
+
+/*
+	ArenaBlockBufferAllocator:  drop in replacement for BlockBufferAllocator as the BAllocator of a SegmentedBuffer,
+	blocks come from the BlockArena for the NUMA node of the thread allocating them
+
+	Rules:
+		1.  a chunk is a small tag (the node it came from), the BlockBuffer header then the BLOCKSIZE payload
+		2.  each thread finds its node once and keeps a lock free cache of chunks from that node, so the blocks of a
+			channel are local to the thread that serves it
+		3.  a block freed on a thread of another node (or once the cache holds HighWaterMark blocks) goes back to the
+			arena it came from
+		4.  if no region can be mapped at all blocks come from the heap, tagged so they go back to the heap
+		5.  arenas live for the life of the process, a block can be released from anywhere at any time
+*/
+template<unsigned int BLOCKSIZE>
+class ArenaBlockBufferAllocator {
+public:
+	static const uint32_t BLOCK_SIZE = BLOCKSIZE;
+	static const uint32_t DEFAULT_HIGH_WATER_MARK = 256;
+public:
+	static BlockBuffer *allocate() {
+		ThreadCache *cache = isDestroyed() ? 0 : &getCache();
+		uint8_t *chunk = 0;
+		uint32_t node = cache ? cache->Node : BlockArena::currentNode();
+		if(cache && cache->Head) {
+			FreeNode *n = cache->Head;
+			cache->Head = n->Next;
+			--cache->Cached;
+			chunk = reinterpret_cast<uint8_t*>(n);
+		} else {
+			chunk = static_cast<uint8_t*>(getArena(node)->allocate());
+			if(!chunk) {
+				chunk = static_cast<uint8_t*>(::operator new(CHUNK_SIZE));
+				node = HEAP_NODE;
+			}
+		}
+		*reinterpret_cast<uint32_t*>(chunk) = node;
+		return new (chunk+TAG_SIZE) BlockBuffer(chunk+TAG_SIZE+HEADER_SIZE,BLOCKSIZE);
+	}
+	static void deallocate(BlockBuffer *buffer) {
+		buffer->~BlockBuffer();
+		uint8_t *chunk = reinterpret_cast<uint8_t*>(buffer)-TAG_SIZE;
+		uint32_t node = *reinterpret_cast<uint32_t*>(chunk);
+		if(node==HEAP_NODE) {
+			::operator delete(static_cast<void*>(chunk));
+			return;
+		}
+		if(!isDestroyed()) {
+			ThreadCache &cache = getCache();
+			if(node==cache.Node && cache.Cached<HighWaterMark.load(std::memory_order_relaxed)) {
+				FreeNode *n = reinterpret_cast<FreeNode*>(chunk);
+				n->Next = cache.Head;
+				cache.Head = n;
+				++cache.Cached;
+				return;
+			}
+		}
+		getArena(node)->deallocate(chunk);
+	}
+	//max number of blocks each thread will cache, applies to all threads
+	static void setHighWaterMark(uint32_t blocks) {
+		HighWaterMark.store(blocks,std::memory_order_relaxed);
+	}
+	//stats for the arena on node, all zero if nothing has been allocated there
+	static BlockArena::Stats getArenaStats(uint32_t node) {
+		BlockArena *arena = node<BlockArena::MAX_NODES ? Arenas[node].load(std::memory_order_acquire) : 0;
+		return arena ? arena->getStats() : BlockArena::Stats();
+	}
+	//node blocks allocated on the calling thread come from
+	static uint32_t getThreadNode() {
+		return isDestroyed() ? BlockArena::currentNode() : getCache().Node;
+	}
+	ArenaBlockBufferAllocator() {}
+private:
+	struct FreeNode {
+		FreeNode *Next;
+	};
+	struct ThreadCache {
+		FreeNode *Head;
+		uint32_t Cached;
+		uint32_t Node;
+		ThreadCache() : Head(0), Cached(0), Node(BlockArena::currentNode()) {}
+		~ThreadCache() {
+			while(Head) {
+				FreeNode *n = Head;
+				Head = n->Next;
+				getArena(Node)->deallocate(n);
+			}
+			Cached = 0;
+			//blocks moving after this (static buffers torn down at exit) go straight to the arena
+			isDestroyed() = true;
+		}
+	};
+	static ThreadCache &getCache() {
+		static thread_local ThreadCache Cache;
+		return Cache;
+	}
+	//outside ThreadCache so it can still be read once the cache has been destroyed
+	static bool &isDestroyed() {
+		static thread_local bool Destroyed = false;
+		return Destroyed;
+	}
+	//arenas are created on first use and never destroyed, see rule #5
+	static BlockArena *getArena(uint32_t node) {
+		node = node<BlockArena::MAX_NODES ? node : 0;
+		BlockArena *arena = Arenas[node].load(std::memory_order_acquire);
+		if(!arena) {
+			BlockArena *created = new BlockArena(CHUNK_SIZE,node);
+			if(Arenas[node].compare_exchange_strong(arena,created,std::memory_order_acq_rel)) {
+				arena = created;
+			} else {
+				delete created;
+			}
+		}
+		return arena;
+	}
+	static const uint32_t HEAP_NODE = 0xFFFFFFFF;
+	static const size_t TAG_SIZE = alignof(std::max_align_t);
+	static const size_t HEADER_SIZE = (sizeof(BlockBuffer)+alignof(std::max_align_t)-1) & ~(alignof(std::max_align_t)-1);
+	static const size_t CHUNK_SIZE = TAG_SIZE+HEADER_SIZE+BLOCKSIZE;
+	static std::atomic<uint32_t> HighWaterMark;
+	static std::atomic<BlockArena*> Arenas[BlockArena::MAX_NODES];
+private:
+	SET_NO_COPY(ArenaBlockBufferAllocator);
+};
+
+template<unsigned int BLOCKSIZE>
+std::atomic<uint32_t> ArenaBlockBufferAllocator<BLOCKSIZE>::HighWaterMark(ArenaBlockBufferAllocator<BLOCKSIZE>::DEFAULT_HIGH_WATER_MARK);
+
+template<unsigned int BLOCKSIZE>
+std::atomic<BlockArena*> ArenaBlockBufferAllocator<BLOCKSIZE>::Arenas[BlockArena::MAX_NODES];
+
+typedef SegmentedBuffer<ArenaBlockBufferAllocator<4000> > ArenaSegmentedBuffer;
+
+}
+
+#endif
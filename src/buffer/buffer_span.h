@@ -0,0 +1,28 @@
+#ifndef WSS_BUFFER_SPAN_H
+#define WSS_BUFFER_SPAN_H
+
+#include <cstddef>
+
+namespace wss {
+
+/*
+	A contiguous run of bytes inside a (possibly segmented) buffer.
+	Laid out like a POSIX iovec / WSABUF pair so a list of them maps directly onto writev/readv
+*/
+struct ConstBufferSpan {
+	const void *Data;
+	size_t Length;
+	ConstBufferSpan() : Data(0), Length(0) {}
+	ConstBufferSpan(const void *d, size_t l) : Data(d), Length(l) {}
+};
+
+struct BufferSpan {
+	void *Data;
+	size_t Length;
+	BufferSpan() : Data(0), Length(0) {}
+	BufferSpan(void *d, size_t l) : Data(d), Length(l) {}
+};
+
+}
+
+#endif
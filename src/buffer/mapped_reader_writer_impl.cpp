@@ -0,0 +1,267 @@
+#include "mapped_reader_writer_impl.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#ifdef WSS_LINUX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace wss;
+
+/**********************************************************************************************
+* MappedReaderWriterImpl::Create -- static create function, opens (or for READ_WRITE creates) fileName and maps it
+*
+*********************************************************************************************/
+IReaderWriter * MappedReaderWriterImpl::Create(const char *fileName, MappedMode mode, ErrorType &et) {
+#ifdef WSS_LINUX
+	int flags = mode==READ_ONLY ? O_RDONLY : (O_RDWR|O_CREAT);
+	int fd = ::open(fileName, flags|O_CLOEXEC, 0644);
+	if(fd<0) {
+		et = ErrorType(ErrorType::codeOSSpecific,errno);
+		return 0;
+	}
+	struct stat st;
+	if(fstat(fd,&st)!=0) {
+		et = ErrorType(ErrorType::codeOSSpecific,errno);
+		::close(fd);
+		return 0;
+	}
+	MappedReaderWriterImpl *impl = new MappedReaderWriterImpl(fd,mode);
+	et = impl->open(size_t(st.st_size));
+	if(!et.ok()) {
+		delete impl;
+		return 0;
+	}
+	return impl;
+#else
+	et = ErrorType(ErrorType::codeOSSpecific,ENOSYS);
+	return 0;
+#endif
+}
+
+MappedReaderWriterImpl::MappedReaderWriterImpl(int fd, MappedMode mode) : FD(fd), Mode(mode), Base(0), Size(0), MappedSize(0), PageSize(4096) {
+#ifdef WSS_LINUX
+	long pageSize = sysconf(_SC_PAGESIZE);
+	if(pageSize>0) {
+		PageSize = size_t(pageSize);
+	}
+#endif
+}
+
+MappedReaderWriterImpl::~MappedReaderWriterImpl() {
+	close();
+}
+
+/**********************************************************************************************
+* MappedReaderWriterImpl::open -- map the file, READ_WRITE maps at least one page so the first write doesn't remap
+*
+*********************************************************************************************/
+ErrorType MappedReaderWriterImpl::open(size_t fileSize) {
+	ErrorType et;
+#ifdef WSS_LINUX
+	Size = fileSize;
+	if(Mode==READ_ONLY) {
+		if(Size==0) {
+			//nothing to map, raw and read just return 0
+			return et;
+		}
+		MappedSize = Size;
+		void *p = mmap(0,MappedSize,PROT_READ,MAP_SHARED,FD,0);
+		if(p==MAP_FAILED) {
+			MappedSize = 0;
+			return ErrorType(ErrorType::codeOSSpecific,errno);
+		}
+		Base = static_cast<uint8_t*>(p);
+	} else {
+		size_t mapSize = (std::max)(PageSize,(Size+PageSize-1)&~(PageSize-1));
+		if(mapSize!=Size && ftruncate(FD,mapSize)!=0) {
+			return ErrorType(ErrorType::codeOSSpecific,errno);
+		}
+		void *p = mmap(0,mapSize,PROT_READ|PROT_WRITE,MAP_SHARED,FD,0);
+		if(p==MAP_FAILED) {
+			et = ErrorType(ErrorType::codeOSSpecific,errno);
+			if(ftruncate(FD,Size)!=0) {
+				//leave the OS error from mmap as the one reported
+			}
+			return et;
+		}
+		Base = static_cast<uint8_t*>(p);
+		MappedSize = mapSize;
+	}
+	madvise(Base,MappedSize,MADV_SEQUENTIAL);
+#endif
+	return et;
+}
+
+/**********************************************************************************************
+* MappedReaderWriterImpl::close -- unmap and for READ_WRITE drop the slack we grew the file by
+*
+*********************************************************************************************/
+void MappedReaderWriterImpl::close() {
+#ifdef WSS_LINUX
+	if(Base) {
+		munmap(Base,MappedSize);
+		Base = 0;
+	}
+	if(FD>=0) {
+		if(Mode==READ_WRITE && MappedSize!=Size && ftruncate(FD,Size)!=0) {
+			//nothing we can do from a dtor, file keeps its zero filled tail
+		}
+		::close(FD);
+		FD = -1;
+	}
+#endif
+	MappedSize = 0;
+}
+
+/**********************************************************************************************
+* MappedReaderWriterImpl::reserve -- grow the file and mapping so at least length bytes are mapped
+*
+*	grows geometrically so a stream of small writes doesn't ftruncate/mremap each time
+*********************************************************************************************/
+bool MappedReaderWriterImpl::reserve(size_t length) {
+	if(length<=MappedSize) {
+		return true;
+	}
+#ifdef WSS_LINUX
+	if(Mode!=READ_WRITE) {
+		return false;
+	}
+	size_t newSize = (std::max)(MappedSize*2,(length+PageSize-1)&~(PageSize-1));
+	if(ftruncate(FD,newSize)!=0) {
+		return false;
+	}
+	void *p = mremap(Base,MappedSize,newSize,MREMAP_MAYMOVE);
+	if(p==MAP_FAILED) {
+		if(ftruncate(FD,MappedSize)!=0) {
+			//still mapped at the old size, the file just keeps extra zeros until close
+		}
+		return false;
+	}
+	Base = static_cast<uint8_t*>(p);
+	MappedSize = newSize;
+	madvise(Base,MappedSize,MADV_SEQUENTIAL);
+	return true;
+#else
+	return false;
+#endif
+}
+
+size_t MappedReaderWriterImpl::read(size_t pos, void * dst, size_t length) {
+	if(pos>=Size) {
+		return 0;
+	}
+	length = (std::min)(length,Size-pos);
+	memcpy(dst,Base+pos,length);
+	return length;
+}
+
+/**********************************************************************************************
+* MappedReaderWriterImpl::readUntilDelim -- same contract as SegmentedBuffer: copies up to (not including) delim
+*	if delim is hit it is null terminated in dst and the number of bytes before delim is returned
+*********************************************************************************************/
+size_t MappedReaderWriterImpl::readUntilDelim(size_t pos, void * dst, size_t length, char delim, bool &wasDelimHit) {
+	wasDelimHit = false;
+	if(pos>=Size) {
+		return 0;
+	}
+	length = (std::min)(length,Size-pos);
+	const uint8_t *src = Base+pos;
+	const void *hit = memchr(src,delim,length);
+	if(hit) {
+		length = static_cast<const uint8_t*>(hit)-src;
+		memcpy(dst,src,length);
+		static_cast<uint8_t*>(dst)[length] = 0;
+		wasDelimHit = true;
+		return length;
+	}
+	memcpy(dst,src,length);
+	return length;
+}
+
+/**********************************************************************************************
+* MappedReaderWriterImpl::write -- writes length bytes from src starting at pos, growing the file if needed
+*	a null src just moves the end of the file (acts as a fill)
+*********************************************************************************************/
+size_t MappedReaderWriterImpl::write(size_t pos, const void * src, size_t length) {
+	if(Mode!=READ_WRITE || pos>Size) {
+		return 0;
+	}
+	if(!reserve(pos+length)) {
+		return 0;
+	}
+	if(src) {
+		memcpy(Base+pos,src,length);
+	}
+	Size = (std::max)(Size,pos+length);
+	return length;
+}
+
+size_t MappedReaderWriterImpl::erase(size_t pos, size_t length) {
+	if(Mode!=READ_WRITE || pos>=Size) {
+		return 0;
+	}
+	length = (std::min)(length,Size-pos);
+	memmove(Base+pos,Base+pos+length,Size-pos-length);
+	Size -= length;
+	return length;
+}
+
+size_t MappedReaderWriterImpl::size() const {
+	return Size;
+}
+
+size_t MappedReaderWriterImpl::capacity() const {
+	return Mode==READ_ONLY ? Size : MappedSize;
+}
+
+bool MappedReaderWriterImpl::fixedCapacity() const {
+	return Mode==READ_ONLY;
+}
+
+size_t MappedReaderWriterImpl::getPreferredBlockSize() const {
+	return PageSize;
+}
+
+//Get raw pointer to data, the mapping is contiguous so this is everything from idx on
+const void * MappedReaderWriterImpl::raw(size_t idx, size_t& out_length) const {
+	if(idx>=Size) {
+		out_length = 0;
+		return 0;
+	}
+	out_length = Size-idx;
+	return Base+idx;
+}
+
+/**********************************************************************************************
+* MappedReaderWriterImpl::prepare -- hands out the mapped space past the end of the file, growing it if needed
+*
+*********************************************************************************************/
+void * MappedReaderWriterImpl::prepare(size_t length, size_t& out_length) {
+	out_length = 0;
+	if(Mode!=READ_WRITE || !reserve(Size+(std::max)(length,size_t(1)))) {
+		return 0;
+	}
+	out_length = MappedSize-Size;
+	return Base+Size;
+}
+
+size_t MappedReaderWriterImpl::commit(size_t length) {
+	length = (std::min)(length,MappedSize-Size);
+	Size += length;
+	return length;
+}
+
+ErrorType MappedReaderWriterImpl::sync(bool async) {
+	ErrorType et;
+#ifdef WSS_LINUX
+	if(Base && Mode==READ_WRITE && msync(Base,MappedSize,async ? MS_ASYNC : MS_SYNC)!=0) {
+		et = ErrorType(ErrorType::codeOSSpecific,errno);
+	}
+#endif
+	return et;
+}
@@ -0,0 +1,71 @@
+#ifndef WSS_MAPPED_READER_WRITER_H
+#define WSS_MAPPED_READER_WRITER_H
+
+#include "../io/ireaderwriter.h"
+#include "../error_type.h"
+#include "../portable_types.h"
+
+namespace wss {
+/*
+	MappedReaderWriterImpl:  IReaderWriter over a memory mapped file
+
+	Meant for parsing large capture/replay files with ReaderWriter without copying them into SegmentedBuffer blocks.
+
+	Rules:
+		1.  the whole file is one mapping so raw(idx) returns everything from idx to size() in one pointer
+		2.  the mapping is madvised sequential, the expected use is a front to back scan
+		3.  READ_ONLY: writes, erases and prepare fail (return 0), capacity() == size()
+		4.  READ_WRITE: writing past the end grows the file and the mapping (which may move it, pointers from raw()
+			and prepare() are only good until the next write), the file is truncated back to size() when closed
+		5.  erase is a memmove of everything after the erased range, fine for the odd fixup not for a queue
+		6.  only available where WSS_LINUX is defined, Create returns null everywhere else
+*/
+class MappedReaderWriterImpl : public IReaderWriter
+{
+public:
+	enum MappedMode {
+		READ_ONLY,
+		READ_WRITE	//file is created if it does not exist
+	};
+	//returns null on failure and et holds the OS error
+	static IReaderWriter * Create(const char *fileName, MappedMode mode, ErrorType &et);
+protected:
+	MappedReaderWriterImpl(int fd, MappedMode mode);
+	ErrorType open(size_t fileSize);
+public:
+	virtual ~MappedReaderWriterImpl();
+	virtual size_t read(size_t pos, void * dst, size_t length);
+	virtual size_t readUntilDelim(size_t pos, void * dst, size_t length, char delim, bool &wasDelimHit);
+	virtual size_t write(size_t pos, const void * src, size_t length);
+	virtual size_t erase(size_t pos, size_t length);
+
+	virtual size_t size() const;
+	virtual size_t capacity() const;
+	virtual bool fixedCapacity() const;
+	virtual size_t getPreferredBlockSize() const;
+
+	//Get raw pointer to data, always everything from idx to the end of the file
+	virtual const void * raw(size_t idx, size_t& out_length) const;
+	virtual void * prepare(size_t length, size_t& out_length);
+	virtual size_t commit(size_t length);
+
+	MappedMode getMode() const {return Mode;}
+	//push dirty pages to the file, async just schedules the write back
+	ErrorType sync(bool async);
+private:
+	//make sure at least length bytes are mapped, grows the file
+	bool reserve(size_t length);
+	void close();
+private:
+	int FD;
+	MappedMode Mode;
+	uint8_t *Base;
+	size_t Size;		//logical size of the file
+	size_t MappedSize;	//bytes mapped (and the size of the file on disk while open for READ_WRITE)
+	size_t PageSize;
+private:
+	SET_NO_COPY(MappedReaderWriterImpl);
+};
+
+}
+#endif
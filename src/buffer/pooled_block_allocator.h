@@ -0,0 +1,129 @@
+#ifndef WSS_POOLED_BLOCK_ALLOCATOR_H
+#define WSS_POOLED_BLOCK_ALLOCATOR_H
+
+#include <new>
+#include <atomic>
+#include <cstddef>
+#include "segmented_buffer.h"
+
+namespace wss {
+
+/*
+	PooledBlockBufferAllocator:  drop in replacement for BlockBufferAllocator as the BAllocator of a SegmentedBuffer
+
+	Rules:
+		1.  The BlockBuffer header and its BLOCKSIZE payload are a single allocation, payload follows the (aligned) header
+		2.  Each thread keeps its own free list so allocate/deallocate never take a lock
+		3.  A block is returned to the free list of the thread that deallocates it, not the thread that allocated it
+		4.  Once a thread's free list holds HighWaterMark blocks, further deallocations go back to the heap
+		5.  Cached blocks are released when the thread exits (or on trim())
+*/
+template<unsigned int BLOCKSIZE>
+class PooledBlockBufferAllocator {
+public:
+	static const uint32_t BLOCK_SIZE = BLOCKSIZE;
+	static const uint32_t DEFAULT_HIGH_WATER_MARK = 256;
+	struct Stats {
+		uint64_t Hits;		//allocations served from the free list
+		uint64_t Misses;	//allocations that went to the heap
+		uint32_t Cached;	//blocks currently in the free list
+		Stats() : Hits(0), Misses(0), Cached(0) {}
+	};
+public:
+	static BlockBuffer *allocate() {
+		if(isDestroyed()) {
+			void *mem = ::operator new(ALLOCATION_SIZE);
+			return new (mem) BlockBuffer(static_cast<uint8_t*>(mem)+HEADER_SIZE,BLOCKSIZE);
+		}
+		ThreadPool &pool = getPool();
+		void *mem = 0;
+		if(pool.Head) {
+			FreeNode *n = pool.Head;
+			pool.Head = n->Next;
+			--pool.PoolStats.Cached;
+			++pool.PoolStats.Hits;
+			mem = n;
+		} else {
+			++pool.PoolStats.Misses;
+			mem = ::operator new(ALLOCATION_SIZE);
+		}
+		return new (mem) BlockBuffer(static_cast<uint8_t*>(mem)+HEADER_SIZE,BLOCKSIZE);
+	}
+	static void deallocate(BlockBuffer *buffer) {
+		buffer->~BlockBuffer();
+		if(!isDestroyed()) {
+			ThreadPool &pool = getPool();
+			if(pool.PoolStats.Cached<HighWaterMark.load(std::memory_order_relaxed)) {
+				FreeNode *n = reinterpret_cast<FreeNode*>(buffer);
+				n->Next = pool.Head;
+				pool.Head = n;
+				++pool.PoolStats.Cached;
+				return;
+			}
+		}
+		::operator delete(static_cast<void*>(buffer));
+	}
+	//max number of blocks each thread will cache, applies to all threads
+	static void setHighWaterMark(uint32_t blocks) {
+		HighWaterMark.store(blocks,std::memory_order_relaxed);
+	}
+	static uint32_t getHighWaterMark() {
+		return HighWaterMark.load(std::memory_order_relaxed);
+	}
+	//stats for the calling thread
+	static const Stats &getStats() {
+		return getPool().PoolStats;
+	}
+	//release every block cached by the calling thread
+	static void trim() {
+		if(!isDestroyed()) {
+			getPool().release();
+		}
+	}
+	PooledBlockBufferAllocator() {}
+private:
+	struct FreeNode {
+		FreeNode *Next;
+	};
+	struct ThreadPool {
+		FreeNode *Head;
+		Stats PoolStats;
+		ThreadPool() : Head(0), PoolStats() {}
+		void release() {
+			while(Head) {
+				FreeNode *n = Head;
+				Head = n->Next;
+				::operator delete(static_cast<void*>(n));
+			}
+			PoolStats.Cached = 0;
+		}
+		~ThreadPool() {
+			release();
+			//blocks moving after this (static buffers torn down at exit) go straight to the heap
+			isDestroyed() = true;
+		}
+	};
+	static ThreadPool &getPool() {
+		static thread_local ThreadPool Pool;
+		return Pool;
+	}
+	//kept outside ThreadPool, a trivially destructible bool is still valid once the pool is gone
+	static bool &isDestroyed() {
+		static thread_local bool Destroyed = false;
+		return Destroyed;
+	}
+	static const size_t HEADER_SIZE = (sizeof(BlockBuffer)+alignof(std::max_align_t)-1) & ~(alignof(std::max_align_t)-1);
+	static const size_t ALLOCATION_SIZE = HEADER_SIZE+BLOCKSIZE;
+	static std::atomic<uint32_t> HighWaterMark;
+private:
+	SET_NO_COPY(PooledBlockBufferAllocator);
+};
+
+template<unsigned int BLOCKSIZE>
+std::atomic<uint32_t> PooledBlockBufferAllocator<BLOCKSIZE>::HighWaterMark(PooledBlockBufferAllocator<BLOCKSIZE>::DEFAULT_HIGH_WATER_MARK);
+
+typedef SegmentedBuffer<PooledBlockBufferAllocator<4000> > PooledSegmentedBuffer;
+
+}
+
+#endif
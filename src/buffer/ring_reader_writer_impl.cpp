@@ -0,0 +1,237 @@
+#include "ring_reader_writer_impl.h"
+#include <cstring>
+#include <algorithm>
+
+#ifdef WSS_LINUX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace wss;
+
+/**********************************************************************************************
+* RingReaderWriterImpl::Create -- static create function, capacity is rounded up to a power of 2
+* 
+*********************************************************************************************/
+IReaderWriter * RingReaderWriterImpl::Create(size_t capacity) {
+	return new RingReaderWriterImpl(capacity);
+}
+
+RingReaderWriterImpl::RingReaderWriterImpl(size_t capacity) : Buffer(0), Capacity(1), Mask(0), Head(0), Tail(0), Mirrored(false) {
+	while(Capacity<capacity) {
+		Capacity<<=1;
+	}
+	Mask = Capacity-1;
+	allocate();
+}
+
+RingReaderWriterImpl::~RingReaderWriterImpl() {
+	release();
+}
+
+/**********************************************************************************************
+* RingReaderWriterImpl::allocate -- try to map the ring twice back to back, fall back to the heap
+*
+*	the mirror needs the capacity to be a multiple of the page size
+*********************************************************************************************/
+void RingReaderWriterImpl::allocate() {
+#if defined(WSS_LINUX) && defined(MFD_CLOEXEC)
+	long pageSize = sysconf(_SC_PAGESIZE);
+	if(pageSize>0 && (Capacity%size_t(pageSize))==0) {
+		int fd = memfd_create("wss_ring",MFD_CLOEXEC);
+		if(fd>=0) {
+			if(ftruncate(fd,Capacity)==0) {
+				void *base = mmap(0,Capacity*2,PROT_NONE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+				if(base!=MAP_FAILED) {
+					uint8_t *b = static_cast<uint8_t*>(base);
+					if(mmap(b,Capacity,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,fd,0)!=MAP_FAILED
+						&& mmap(b+Capacity,Capacity,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,fd,0)!=MAP_FAILED) {
+						Buffer = b;
+						Mirrored = true;
+					} else {
+						munmap(base,Capacity*2);
+					}
+				}
+			}
+			close(fd);
+		}
+	}
+#endif
+	if(!Buffer) {
+		Buffer = new uint8_t[Capacity];
+		Mirrored = false;
+	}
+}
+
+void RingReaderWriterImpl::release() {
+#ifdef WSS_LINUX
+	if(Mirrored) {
+		munmap(Buffer,Capacity*2);
+		Buffer = 0;
+		return;
+	}
+#endif
+	delete [] Buffer;
+	Buffer = 0;
+}
+
+size_t RingReaderWriterImpl::contiguous(size_t pos) const {
+	if(Mirrored) {
+		return Capacity;
+	}
+	return Capacity-((Head+pos)&Mask);
+}
+
+/**********************************************************************************************
+* RingReaderWriterImpl::read -- reads length bytes into dst from pos, at most 2 copies if we wrap
+* 
+*********************************************************************************************/
+size_t RingReaderWriterImpl::read(size_t pos, void * dst, size_t length) {
+	if(pos>=size()) {
+		return 0;
+	}
+	length = (std::min)(length,size()-pos);
+	size_t copied = 0;
+	while(copied<length) {
+		size_t chunk = (std::min)(length-copied,contiguous(pos+copied));
+		memcpy(static_cast<uint8_t*>(dst)+copied,at(pos+copied),chunk);
+		copied += chunk;
+	}
+	return length;
+}
+
+/**********************************************************************************************
+* RingReaderWriterImpl::readUntilDelim -- same contract as SegmentedBuffer: copies up to (not including) delim
+*	if delim is hit it is null terminated in dst and the number of bytes before delim is returned
+*********************************************************************************************/
+size_t RingReaderWriterImpl::readUntilDelim(size_t pos, void * dst, size_t length, char delim, bool &wasDelimHit) {
+	wasDelimHit = false;
+	if(pos>=size()) {
+		return 0;
+	}
+	length = (std::min)(length,size()-pos);
+	size_t copied = 0;
+	uint8_t *out = static_cast<uint8_t*>(dst);
+	while(copied<length) {
+		size_t chunk = (std::min)(length-copied,contiguous(pos+copied));
+		const uint8_t *src = at(pos+copied);
+		const void *hit = memchr(src,delim,chunk);
+		if(hit) {
+			size_t n = static_cast<const uint8_t*>(hit)-src;
+			memcpy(out+copied,src,n);
+			copied += n;
+			out[copied] = 0;
+			wasDelimHit = true;
+			return copied;
+		}
+		memcpy(out+copied,src,chunk);
+		copied += chunk;
+	}
+	return copied;
+}
+
+/**********************************************************************************************
+* RingReaderWriterImpl::write -- writes length bytes from src starting at pos, never more than capacity
+*	a null src just moves the tail (acts as a fill)
+*********************************************************************************************/
+size_t RingReaderWriterImpl::write(size_t pos, const void * src, size_t length) {
+	if(pos>size() || pos>=Capacity) {
+		return 0;
+	}
+	length = (std::min)(length,Capacity-pos);
+	size_t copied = 0;
+	while(copied<length) {
+		size_t chunk = (std::min)(length-copied,contiguous(pos+copied));
+		if(src) {
+			memcpy(at(pos+copied),static_cast<const uint8_t*>(src)+copied,chunk);
+		}
+		copied += chunk;
+	}
+	Tail = (std::max)(Tail,Head+pos+length);
+	return length;
+}
+
+/**********************************************************************************************
+* RingReaderWriterImpl::erase -- erases length bytes starting at pos, bytes after the erased range are moved down
+* 
+*********************************************************************************************/
+size_t RingReaderWriterImpl::erase(size_t pos, size_t length) {
+	if(pos==0) {
+		return consume(length);
+	}
+	if(pos>=size()) {
+		return 0;
+	}
+	length = (std::min)(length,size()-pos);
+	size_t to = pos;
+	size_t from = pos+length;
+	while(from<size()) {
+		//chunk on physical boundaries even when mirrored, memmove can't see overlap through the mirror alias
+		size_t chunk = (std::min)((std::min)(size()-from,Capacity-((Head+from)&Mask)),Capacity-((Head+to)&Mask));
+		memmove(at(to),at(from),chunk);
+		to += chunk;
+		from += chunk;
+	}
+	Tail -= length;
+	return length;
+}
+
+/**********************************************************************************************
+* RingReaderWriterImpl::consume -- erase from the front is just moving the head
+* 
+*********************************************************************************************/
+size_t RingReaderWriterImpl::consume(size_t length) {
+	length = (std::min)(length,size());
+	Head += length;
+	if(Head==Tail) {
+		//empty, start over at the beginning of the ring so the next raw/prepare is as large as possible
+		Head = Tail = 0;
+	}
+	return length;
+}
+
+size_t RingReaderWriterImpl::size() const {
+	return Tail-Head;
+}
+
+size_t RingReaderWriterImpl::capacity() const {
+	return Capacity;
+}
+
+bool RingReaderWriterImpl::fixedCapacity() const {
+	return true;
+}
+
+size_t RingReaderWriterImpl::getPreferredBlockSize() const {
+	return Capacity;
+}
+
+//Get raw pointer to data, if the ring is mirrored this is everything from idx on
+const void * RingReaderWriterImpl::raw(size_t idx, size_t& out_length) const {
+	if(idx>=size()) {
+		out_length = 0;
+		return 0;
+	}
+	out_length = (std::min)(size()-idx,contiguous(idx));
+	return at(idx);
+}
+
+/**********************************************************************************************
+* RingReaderWriterImpl::prepare -- hands out the free space after the tail, null if the ring is full
+* 
+*********************************************************************************************/
+void * RingReaderWriterImpl::prepare(size_t /*length*/, size_t& out_length) {
+	size_t free = Capacity-size();
+	if(free==0) {
+		out_length = 0;
+		return 0;
+	}
+	out_length = (std::min)(free,contiguous(size()));
+	return at(size());
+}
+
+size_t RingReaderWriterImpl::commit(size_t length) {
+	length = (std::min)(length,Capacity-size());
+	Tail += length;
+	return length;
+}
@@ -0,0 +1,65 @@
+#ifndef WSS_RING_READER_WRITER_H
+#define WSS_RING_READER_WRITER_H
+
+#include "../io/ireaderwriter.h"
+#include "../portable_types.h"
+
+namespace wss {
+/*
+	RingReaderWriterImpl:  fixed capacity IReaderWriter backed by a single power of two ring
+
+	Meant for bounded channels where the amount buffered never gets large, steady state does no allocation and
+	every byte lives in one contiguous allocation.
+
+	Rules:
+		1.  capacity is rounded up to a power of two, positions are masked into the ring
+		2.  where the OS supports it (linux memfd) the ring is mapped twice back to back so a pointer from raw() or
+			prepare() can run past the physical end of the ring, i.e. raw() always returns everything from idx to size()
+		3.  if the ring could not be mirrored raw() and prepare() stop at the physical end of the ring, callers
+			already have to handle raw() returning less than size() (see SegmentedBuffer)
+		4.  fixedCapacity() is true, ReaderWriter truncates writes that do not fit
+*/
+class RingReaderWriterImpl : public IReaderWriter
+{
+public:
+	static IReaderWriter * Create(size_t capacity);
+protected:
+	RingReaderWriterImpl(size_t capacity);
+public:
+	virtual ~RingReaderWriterImpl();
+	virtual size_t read(size_t pos, void * dst, size_t length);
+	virtual size_t readUntilDelim(size_t pos, void * dst, size_t length, char delim, bool &wasDelimHit);
+	virtual size_t write(size_t pos, const void * src, size_t length);
+	virtual size_t erase(size_t pos, size_t length);
+	virtual size_t consume(size_t length);
+
+	virtual size_t size() const;
+	virtual size_t capacity() const;
+	virtual bool fixedCapacity() const;
+	virtual size_t getPreferredBlockSize() const;
+
+	//Get raw pointer to data
+	virtual const void * raw(size_t idx, size_t& out_length) const;
+	virtual void * prepare(size_t length, size_t& out_length);
+	virtual size_t commit(size_t length);
+
+	bool isMirrored() const {return Mirrored;}
+private:
+	uint8_t *at(size_t pos) const {return Buffer+((Head+pos)&Mask);}
+	//contiguous bytes from pos before we hit the physical end of the ring
+	size_t contiguous(size_t pos) const;
+	void allocate();
+	void release();
+private:
+	uint8_t *Buffer;
+	size_t Capacity;
+	size_t Mask;
+	size_t Head;	//absolute read index (never masked)
+	size_t Tail;	//absolute write index (never masked), size = Tail - Head
+	bool Mirrored;
+private:
+	SET_NO_COPY(RingReaderWriterImpl);
+};
+
+}
+#endif
@@ -1,4 +1,8 @@
 #include "segmented_buffer.h"
+#include "pooled_block_allocator.h"
+#include "arena_block_allocator.h"
+#include "shared_buffer.h"
+#include <new>
 #include <cstring>
 #include <cassert>
 
@@ -17,7 +21,8 @@ namespace wss {
 
 }
 
-BlockBuffer::BlockBuffer(uint8_t *buf, uint32_t size) : allocatedStart(buf), start(buf), deepestWrite(start), end(buf+size) {
+BlockBuffer::BlockBuffer(uint8_t *buf, uint32_t size) : allocatedStart(buf), start(buf), deepestWrite(start), end(buf+size)
+	, refCount(1), allocated(size), parent(0), releaser(0) {
 
 }
 
@@ -27,18 +32,21 @@ void BlockBuffer::swap(BlockBuffer &bb) {
 	uint8_t *oend = end;
 	uint8_t *dw = deepestWrite;
 	uint8_t *aStart = allocatedStart;
+	uint32_t aSize = allocated;
 
 	//this
 	start = bb.start;
 	end = bb.end;
 	deepestWrite = bb.deepestWrite;
 	allocatedStart = bb.allocatedStart;
+	allocated = bb.allocated;
 
 	//other
 	bb.start = ostart;
 	bb.end = oend;
 	bb.deepestWrite = dw;
 	bb.allocatedStart = aStart;
+	bb.allocated = aSize;
 }
 
 uint32_t BlockBuffer::CopyTo(uint32_t pos, uint8_t* toBuffer, uint32_t sizeToCopy) const  {
@@ -48,20 +56,26 @@ uint32_t BlockBuffer::CopyTo(uint32_t pos, uint8_t* toBuffer, uint32_t sizeToCop
 	return toCopy;
 }
 
+/**********************************************************************************************
+* BlockBuffer::CopyToWithDelim -- copy up to (not including) delim, null terminates toBuffer if delim is hit
+*
+*	find the delim first then copy the span, memchr is vectorized (and picked at runtime for the cpu by libc)
+*	so this runs at memory speed rather than a compare and store per byte
+*********************************************************************************************/
 uint32_t BlockBuffer::CopyToWithDelim(uint32_t pos, uint8_t* toBuffer, uint32_t sizeToCopy, char delim, bool &delimHit) const  {
-  delimHit = false;
+	delimHit = false;
 	uint32_t MaxToCopy = (bytesWritten()-pos) >= 0 ? (bytesWritten()-pos) : 0;
 	MaxToCopy = (std::min)(MaxToCopy,sizeToCopy);
-  uint32_t copied = 0;
-  for(;copied<MaxToCopy;++copied) {
-    if(static_cast<char>(start[pos])==delim) {
-      toBuffer[copied] = 0;
-      delimHit = true;
-      return copied;
-    } else {
-      toBuffer[copied] = start[pos++];
-    }
-  }
+	uint32_t copied = MaxToCopy;
+	const void *hit = memchr(&start[pos],delim,MaxToCopy);
+	if(hit) {
+		copied = static_cast<uint32_t>(static_cast<const uint8_t*>(hit)-&start[pos]);
+		delimHit = true;
+	}
+	memcpy(toBuffer,&start[pos],copied);
+	if(delimHit) {
+		toBuffer[copied] = 0;
+	}
 	return copied;
 }
 
@@ -71,8 +85,8 @@ uint32_t BlockBuffer::CopyFrom(uint32_t pos, const uint8_t* fromBuffer, uint32_t
 	if(fromBuffer) {
 		memcpy(&start[pos],fromBuffer,toCopy);
 	}
-	//move deepest write
-	deepestWrite = (deepestWrite+toCopy)>deepestWrite ? (deepestWrite+toCopy) : deepestWrite;
+	//move deepest write, an overwrite of bytes already written must not move it
+	deepestWrite = (&start[pos+toCopy])>deepestWrite ? (&start[pos+toCopy]) : deepestWrite;
 	return toCopy;
 }
 
@@ -133,6 +147,26 @@ void BlockBuffer::setStart(uint32_t pos) {
 	assert(end>=start);
 }
 
+void BlockBuffer::prepend(const uint8_t *fromBuffer, uint32_t len) {
+	assert(len<=headroom());
+	start -= len;
+	memcpy(start,fromBuffer,len);
+}
+
+void BlockBuffer::reserveFront(uint32_t len) {
+	assert(isEmpty());
+	deepestWrite = start = allocatedStart+(std::min)(len,static_cast<uint32_t>(end-allocatedStart));
+}
+
+/**********************************************************************************************
+* BlockBuffer::reset -- empties the buffer, start goes back to the beginning of the allocation
+*
+*********************************************************************************************/
+void BlockBuffer::reset() {
+	deepestWrite = start = allocatedStart;
+	end = allocatedStart+allocated;
+}
+
 /**********************************************************************************************
 * BlockBuffer::capacity -- returns capacity of this buffer
 *
@@ -170,7 +204,91 @@ void BlockBuffer::syncCapacityWithBytesWritten() {
 }
 
 BlockBuffer::~BlockBuffer() {
-	delete [] allocatedStart;
+}
+
+void BlockBuffer::addRef() {
+	refCount.fetch_add(1,std::memory_order_relaxed);
+}
+
+/**********************************************************************************************
+* BlockBuffer::release -- drop a ref, views are always private to one list so they go right away
+*
+*********************************************************************************************/
+void BlockBuffer::release(BlockBuffer *bb) {
+	if(bb->parent) {
+		BlockBuffer *owner = bb->parent;
+		delete bb;
+		release(owner);
+	} else if(bb->refCount.fetch_sub(1,std::memory_order_acq_rel)==1) {
+		assert(bb->releaser);
+		bb->releaser(bb);
+	}
+}
+
+bool BlockBuffer::isShared() const {
+	return parent!=0 || refCount.load(std::memory_order_acquire)>1;
+}
+
+/**********************************************************************************************
+* BlockBuffer::createView -- new header over part of owner's payload, sealed so nothing can be appended to it
+*
+*********************************************************************************************/
+BlockBuffer *BlockBuffer::createView(BlockBuffer *owner, const uint8_t *data, uint32_t len) {
+	owner = owner->getOwner();
+	owner->addRef();
+	BlockBuffer *bb = new BlockBuffer(const_cast<uint8_t*>(data),len);
+	bb->fill();
+	bb->parent = owner;
+	return bb;
+}
+
+namespace {
+	const size_t EXACT_HEADER_SIZE = (sizeof(BlockBuffer)+alignof(std::max_align_t)-1) & ~(alignof(std::max_align_t)-1);
+}
+
+BlockBuffer *BlockBuffer::allocateExact(uint32_t size) {
+	void *mem = ::operator new(EXACT_HEADER_SIZE+size);
+	BlockBuffer *bb = new (mem) BlockBuffer(static_cast<uint8_t*>(mem)+EXACT_HEADER_SIZE,size);
+	bb->releaser = &BlockBuffer::freeExact;
+	return bb;
+}
+
+void BlockBuffer::freeExact(BlockBuffer *bb) {
+	bb->~BlockBuffer();
+	::operator delete(static_cast<void*>(bb));
+}
+
+BlockSizePolicy BlockSizePolicy::Fixed(uint32_t blockSize) {
+	BlockSizePolicy p;
+	p.Type = FIXED;
+	p.BlockSize = p.MaxBlockSize = blockSize;
+	return p;
+}
+
+BlockSizePolicy BlockSizePolicy::Adaptive(uint32_t firstBlockSize, uint32_t maxBlockSize) {
+	BlockSizePolicy p;
+	p.Type = ADAPTIVE;
+	p.BlockSize = firstBlockSize;
+	p.MaxBlockSize = (std::max)(firstBlockSize,maxBlockSize);
+	return p;
+}
+
+/**********************************************************************************************
+* BlockSizePolicy::nextBlockSize -- size of the next block for a buffer holding bufferSize bytes
+*
+*	Adaptive doubles the first block size while that is no more than half of what is buffered, so
+*	the blocks go 1,1,2,4,8.. times the first size as the buffer fills up.  Once the buffer is
+*	drained it is back to small blocks.
+*
+*********************************************************************************************/
+uint32_t BlockSizePolicy::nextBlockSize(uint64_t bufferSize) const {
+	uint32_t size = BlockSize;
+	if(Type==ADAPTIVE && size>0) {
+		while(size<MaxBlockSize && uint64_t(size)*2<=bufferSize) {
+			size = uint32_t((std::min)(uint64_t(size)*2,uint64_t(MaxBlockSize)));
+		}
+	}
+	return size;
 }
 
 template<typename BAllocator>
@@ -190,13 +308,13 @@ typename SegmentedBuffer<BAllocator>::Position SegmentedBuffer<BAllocator>::Posi
 	} else {
 #ifdef VALIDATE_SEGMENTED_BUFFER
 		BufferListType::const_iterator it = buf->BufferList.begin();
-		uint32_t totalCapacity = 0;
+		pos_type totalCapacity = 0;
 		uint32_t lastCapacity = 0;
-		size_type index = 0;
+		index_type index = 0;
 		for(;it!=buf->BufferList.end();++it,++index) {
 			totalCapacity+= (lastCapacity=(*it)->capacity());
 			if(pos<=totalCapacity) {
-				return Position(index,(pos - (totalCapacity-lastCapacity)), buf);
+				return Position(index,uint32_t(pos - (totalCapacity-lastCapacity)), buf);
 			}
 		}
 		return Position(INVALID_INDEX,0,0);
@@ -212,13 +330,13 @@ typename SegmentedBuffer<BAllocator>::Position SegmentedBuffer<BAllocator>::Posi
 template<typename BAllocator>
 typename SegmentedBuffer<BAllocator>::Position SegmentedBuffer<BAllocator>::getEnd() {
 	assert(BufferList.size());
-	return Position(uint32_t(BufferList.size()-1),BufferList[BufferList.size()-1]->bytesWritten(),this);
+	return Position(index_type(BufferList.size()-1),BufferList[BufferList.size()-1]->bytesWritten(),this);
 }
 
 template<typename BAllocator>
 typename SegmentedBuffer<BAllocator>::pos_type SegmentedBuffer<BAllocator>::Position::convertToLinearOffset() const {
-	uint32_t pos = 0;
-	for(uint32_t i=0;i<Index;i++) {
+	pos_type pos = 0;
+	for(index_type i=0;i<Index;i++) {
 		pos += SBuffer->BufferList[i]->capacity();
 	}
 	return (pos+OffSet);
@@ -230,22 +348,130 @@ bool SegmentedBuffer<BAllocator>::Position::operator>(const typename SegmentedBu
 }
 
 template<typename BAllocator>
-SegmentedBuffer<BAllocator>::Position::Position(size_type index, size_type offSet, const SegmentedBuffer<BAllocator> *buf) : Index(index), OffSet(offSet), SBuffer(buf) {}
+SegmentedBuffer<BAllocator>::Position::Position(index_type index, uint32_t offSet, const SegmentedBuffer<BAllocator> *buf) : Index(index), OffSet(offSet), SBuffer(buf) {}
 
 template<typename BAllocator>
-SegmentedBuffer<BAllocator>::SegmentedBuffer() {
-	BufferList.push_back(BAllocator::allocate());
+SegmentedBuffer<BAllocator>::SegmentedBuffer() : SizePolicy(), AllocatedBytes(0), AutoCompactRatio(0), Headroom(0) {
+	BufferList.push_back(allocateBlock(0));
+	AllocatedBytes = BufferList.back()->allocatedSize();
+	EncodeBufferList();
+}
+
+template<typename BAllocator>
+SegmentedBuffer<BAllocator>::SegmentedBuffer(const BlockSizePolicy &policy) : SizePolicy(policy), AllocatedBytes(0), AutoCompactRatio(0), Headroom(0) {
+	BufferList.push_back(allocateBlock(0));
+	AllocatedBytes = BufferList.back()->allocatedSize();
+	EncodeBufferList();
 }
 
 template<typename BAllocator>
 SegmentedBuffer<BAllocator>::~SegmentedBuffer() {
-	std::for_each(BufferList.begin(),BufferList.end(),&BAllocator::deallocate);
+	std::for_each(BufferList.begin(),BufferList.end(),&BlockBuffer::release);
 }
 
+/*
+	every block we allocate goes back through BlockBuffer::release, the owner of a payload may outlive this buffer
+	if it was shared so it has to know how to free itself
+*/
+template<typename BAllocator>
+template<typename A>
+BlockBuffer *SegmentedBuffer<BAllocator>::allocateFrom() {
+	BlockBuffer *bb = A::allocate();
+	bb->setReleaseFunction(&A::deallocate);
+	return bb;
+}
 
 template<typename BAllocator>
-SegmentedBuffer<BAllocator>::SegmentedBuffer(const SegmentedBuffer<BAllocator> &sb) : BufferList(sb.BufferList)
+uint32_t SegmentedBuffer<BAllocator>::blockSizeFor(size_type bufferSize) const {
+	uint32_t size = SizePolicy.nextBlockSize(bufferSize);
+	return size ? size : uint32_t(BLOCK_SIZE);
+}
+
+template<typename BAllocator>
+BlockBuffer *SegmentedBuffer<BAllocator>::allocateBlock(size_type bufferSize) const {
+	return allocateBlockOfSize(blockSizeFor(bufferSize));
+}
+
+/*
+	size classes:  our own block size from BAllocator, the page sized classes from their pools and anything
+	else gets an exactly sized block.  Blocks from different classes can sit in the same list since each one
+	carries the function that frees it
+*/
+template<typename BAllocator>
+BlockBuffer *SegmentedBuffer<BAllocator>::allocateBlockOfSize(uint32_t size) {
+	if(size==BLOCK_SIZE) {
+		return allocateFrom<BAllocator>();
+	} else if(size==BlockSizePolicy::PAGE_4K) {
+		return allocateFrom<PooledBlockBufferAllocator<BlockSizePolicy::PAGE_4K> >();
+	} else if(size==BlockSizePolicy::PAGE_16K) {
+		return allocateFrom<PooledBlockBufferAllocator<BlockSizePolicy::PAGE_16K> >();
+	} else if(size==BlockSizePolicy::PAGE_64K) {
+		return allocateFrom<PooledBlockBufferAllocator<BlockSizePolicy::PAGE_64K> >();
+	}
+	return BlockBuffer::allocateExact(size);
+}
+
+/*
+	copy a shared block so it can be written to, bytes written and capacity are kept so the block list rules hold.
+	Payloads that fit in one of our blocks get one from the allocator, anything bigger (a view from another
+	buffer type or a block the size policy made bigger) gets a block of its size class
+*/
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::unshare(index_type index) {
+	BlockBuffer *bb = BufferList[index];
+	BlockBuffer *copy = allocateBlockOfSize(bb->capacity()<=BLOCK_SIZE ? uint32_t(BLOCK_SIZE) : bb->capacity());
+	copy->CopyFrom(0,bb->getStart(),bb->bytesWritten());
+	if(index!=(BufferList.size()-1)) {
+		copy->syncCapacityWithBytesWritten();
+	}
+	BufferList[index] = copy;
+	AllocatedBytes += copy->allocatedSize();
+	AllocatedBytes -= bb->allocatedSize();
+	BlockBuffer::release(bb);
+}
+
+
+/*
+	copy on write:  each of sb's blocks gets a view here, the view holds a ref on the payload so sb sees its blocks as
+	shared and copies before it writes into one, the same as we do.  Only headers are allocated, the views are
+	sealed so our first append starts a new block
+*/
+template<typename BAllocator>
+SegmentedBuffer<BAllocator>::SegmentedBuffer(const SegmentedBuffer<BAllocator> &sb) : BufferList(), SizePolicy(sb.SizePolicy)
+	, AllocatedBytes(0), AutoCompactRatio(sb.AutoCompactRatio), Headroom(sb.Headroom)
 {
+	for(typename BufferListType::const_iterator it=sb.BufferList.begin();it!=sb.BufferList.end();++it) {
+		BlockBuffer *bb = *it;
+		if(bb->bytesWritten()>0) {
+			BufferList.push_back(BlockBuffer::createView(bb,bb->getStart(),bb->bytesWritten()));
+			AllocatedBytes += bb->bytesWritten();
+		}
+	}
+	if(BufferList.empty()) {
+		BufferList.push_back(allocateBlock(0));
+		AllocatedBytes += BufferList.back()->allocatedSize();
+		applyHeadroom();
+	}
+	EncodeBufferList();
+}
+
+template<typename BAllocator>
+SegmentedBuffer<BAllocator> &SegmentedBuffer<BAllocator>::operator=(const SegmentedBuffer<BAllocator> &sb) {
+	if(this!=&sb) {
+		SegmentedBuffer copy(sb);
+		swap(copy);
+	}
+	return *this;
+}
+
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::swap(SegmentedBuffer<BAllocator> &sb) {
+	BufferList.swap(sb.BufferList);
+	std::swap(SizePolicy,sb.SizePolicy);
+	std::swap(AllocatedBytes,sb.AllocatedBytes);
+	std::swap(AutoCompactRatio,sb.AutoCompactRatio);
+	std::swap(Headroom,sb.Headroom);
+	EncodedCollection.swap(sb.EncodedCollection);
 }
 
 /*
@@ -275,16 +501,40 @@ const void *SegmentedBuffer<BAllocator>::raw(pos_type pos, uint32_t &outSize) co
 	}
 }
 
+/*
+	scatter/gather version of raw, walks the blocks from pos handing back a pointer/length per block
+	so the whole range can be given to writev without copying.  Like raw, only bytes written are returned
+*/
+template<typename BAllocator>
+typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::getSpans(pos_type pos, size_type length, ConstBufferSpan *spans, size_type maxSpans) const {
+	Position s = Position::convertFromLinearPosition(pos,this);
+	size_type count = 0;
+	if(s.Is_Valid()) {
+		index_type currentIndex = s.Index;
+		uint32_t currentOffSet = s.OffSet;
+		while(length>0 && count<maxSpans && currentIndex<BufferList.size()) {
+			const BlockBuffer *bb = BufferList[currentIndex++];
+			if(currentOffSet<bb->bytesWritten()) {
+				size_type avail = (std::min)(size_type(bb->bytesWritten()-currentOffSet),length);
+				spans[count++] = ConstBufferSpan(bb->getStart()+currentOffSet,avail);
+				length -= avail;
+			}
+			currentOffSet = 0;
+		}
+	}
+	return count;
+}
+
 template<typename BAllocator>
 typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::read(pos_type readPos, void *outBuff, size_type outBufferSize) {
 	Position ReadPos = Position::convertFromLinearPosition(readPos,this);
 	if(ReadPos.Is_Valid()) {
 		size_type copiedTotal = 0;
 		size_type leftToCopy = outBufferSize;
-		size_type currentIndex = ReadPos.Index;
-		size_type currentOffSet = ReadPos.OffSet;
+		index_type currentIndex = ReadPos.Index;
+		uint32_t currentOffSet = ReadPos.OffSet;
 		while(leftToCopy>0 && currentIndex<BufferList.size()) {
-			size_type copied = BufferList[currentIndex++]->CopyTo(currentOffSet,static_cast<uint8_t*>(outBuff)+copiedTotal,leftToCopy);
+			size_type copied = BufferList[currentIndex++]->CopyTo(currentOffSet,static_cast<uint8_t*>(outBuff)+copiedTotal,blockLength(leftToCopy));
 			copiedTotal += copied;
 			leftToCopy -= copied;
 			currentOffSet = 0;
@@ -302,16 +552,17 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::rea
 	if(ReadPos.Is_Valid()) {
 		size_type copiedTotal = 0;
 		size_type leftToCopy = outBufferSize;
-		size_type currentIndex = ReadPos.Index;
-		size_type currentOffSet = ReadPos.OffSet;
+		index_type currentIndex = ReadPos.Index;
+		uint32_t currentOffSet = ReadPos.OffSet;
 		while(leftToCopy>0 && currentIndex<BufferList.size()) {
-			size_type copied = BufferList[currentIndex++]->CopyToWithDelim(currentOffSet,static_cast<uint8_t*>(outBuff)+copiedTotal,leftToCopy,delim, bDelimHit);
+			size_type copied = BufferList[currentIndex++]->CopyToWithDelim(currentOffSet,static_cast<uint8_t*>(outBuff)+copiedTotal,blockLength(leftToCopy),delim, bDelimHit);
 			copiedTotal += copied;
 			leftToCopy -= copied;
 			currentOffSet = 0;
-      if(bDelimHit) {
-        break;
-      }
+			if(bDelimHit) {
+				//only the bytes before the delim were read, the caller's cursor must stop there
+				return copiedTotal;
+			}
 		}
 		return outBufferSize;
 	} else {
@@ -319,6 +570,31 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::rea
 	}
 }
 
+/*
+	find delim without copying anything, memchr each block from pos on.  Returns false if delim is not in the buffer
+*/
+template<typename BAllocator>
+bool SegmentedBuffer<BAllocator>::findDelim(pos_type pos, char delim, pos_type &delimPos) const {
+	Position s = Position::convertFromLinearPosition(pos,this);
+	if(s.Is_Valid()) {
+		pos_type blockStart = pos-s.OffSet;
+		uint32_t currentOffSet = s.OffSet;
+		for(index_type currentIndex=s.Index;currentIndex<BufferList.size();currentIndex++) {
+			const BlockBuffer *bb = BufferList[currentIndex];
+			if(currentOffSet<bb->bytesWritten()) {
+				const void *hit = memchr(bb->getStart()+currentOffSet,delim,bb->bytesWritten()-currentOffSet);
+				if(hit) {
+					delimPos = blockStart+pos_type(static_cast<const uint8_t*>(hit)-bb->getStart());
+					return true;
+				}
+			}
+			blockStart += bb->bytesWritten();
+			currentOffSet = 0;
+		}
+	}
+	return false;
+}
+
 template<typename BAllocator>
 typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::getBlockCount() {
 	return (size_type)BufferList.size();
@@ -326,59 +602,34 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::get
 
 template<typename BAllocator>
 void SegmentedBuffer<BAllocator>::EncodeBufferList() {
-	BufferListType::iterator it = BufferList.begin();
-	uint32_t lastSize=0xFFFFFFFF;
-	uint32_t count=0;
-	EncodedCollection.resize(0);
-	for(;it!=BufferList.end();++it) {
-		if((*it)->bytesWritten()==lastSize) {
-			EncodedCollection.back().endIndex = count++;
-		} else {
-			Encoded e;
-			e.endIndex = e.startIndex = count++;
-			//favor bytes written over capacity per block even though they can only be different for the last block
-			e.BytesWritten = (*it)->bytesWritten();
-			EncodedCollection.push_back(e);
-			lastSize = e.BytesWritten;
-		}
-	}
+	EncodeBufferListFrom(0);
 }
 
+/*
+	Re-encode the buffer list starting at block 'index', runs covering blocks before 'index' are left alone.
+	Appends only touch the tail blocks so this keeps a write O(blocks touched) rather than O(blocks)
+*/
 template<typename BAllocator>
-void SegmentedBuffer<BAllocator>::UpdateEncodeEnd() {
-	uint32_t lastIndex=EncodedCollection.empty() ? 0 : EncodedCollection.back().endIndex;
-	if(EncodedCollection.empty()) {
-		Encoded e;
-		e.endIndex = e.startIndex = lastIndex;
+void SegmentedBuffer<BAllocator>::EncodeBufferListFrom(index_type index) {
+	//drop runs that start at or after index and trim the run that straddles it
+	while(!EncodedCollection.empty() && EncodedCollection.back().startIndex>=index) {
+		EncodedCollection.pop_back();
+	}
+	if(!EncodedCollection.empty() && EncodedCollection.back().endIndex>=index) {
+		EncodedCollection.back().endIndex = index-1;
+	}
+	index_type bsize = (index_type)BufferList.size();
+	for(index_type i=index;i<bsize;i++) {
 		//favor bytes written over capacity per block even though they can only be different for the last block
-		e.BytesWritten = BufferList[lastIndex]->bytesWritten();
-		EncodedCollection.push_back(e);
-		lastIndex++;
-	} else if(EncodedCollection.back().endIndex-EncodedCollection.back().startIndex>0) {
-		if(EncodedCollection.back().BytesWritten!=BufferList[lastIndex]->bytesWritten()) {
-			EncodedCollection.back().endIndex--;
-			Encoded e;
-			e.endIndex = e.startIndex = lastIndex;
-			//favor bytes written over capacity per block even though they can only be different for the last block
-			e.BytesWritten = BufferList[lastIndex]->bytesWritten();
-			EncodedCollection.push_back(e);
-			lastIndex++;
-		}
-	} else if(EncodedCollection.back().BytesWritten!=BufferList[lastIndex]->bytesWritten()) {
-		EncodedCollection.back().BytesWritten = BufferList[lastIndex]->bytesWritten();
-	}
-	uint32_t lastSize=EncodedCollection.back().BytesWritten;
-	uint32_t bsize = (uint32_t)BufferList.size();
-	for(uint32_t i=EncodedCollection.back().endIndex+1;i<bsize;i++) {
-		if(BufferList[i]->bytesWritten()==lastSize) {
-			EncodedCollection.back().endIndex = lastIndex++;
+		uint32_t bytesWritten = BufferList[i]->bytesWritten();
+		if(!EncodedCollection.empty() && EncodedCollection.back().BytesWritten==bytesWritten) {
+			EncodedCollection.back().endIndex = i;
 		} else {
 			Encoded e;
-			e.endIndex = e.startIndex = lastIndex++;
-			//favor bytes written over capacity per block even though they can only be different for the last block
-			e.BytesWritten = BufferList[i]->bytesWritten();
+			e.endIndex = e.startIndex = i;
+			e.BytesWritten = bytesWritten;
+			e.startLinear = EncodedCollection.empty() ? 0 : EncodedCollection.back().endLinear();
 			EncodedCollection.push_back(e);
-			lastSize = e.BytesWritten;
 		}
 	}
 }
@@ -394,33 +645,29 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::Enc
 //
 template<typename BAllocator>
 typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::EncodeSize(bool forCapacity) const {
-	uint32_t size = 0;
-	EncodeListTypeCIT it = EncodedCollection.begin();
-	for(;it!=EncodedCollection.end();++it) {
-		size+=(*it).BytesWritten*(((*it).endIndex-(*it).startIndex)+1);
-	}
+	size_type size = EncodedCollection.empty() ? 0 : EncodedCollection.back().endLinear();
 	if(forCapacity) {
-		size+=BufferList[BufferList.size()-1]->capacity()-BufferList[BufferList.size()-1]->bytesWritten();
+		size+=BufferList[BufferList.size()-1]->bytesLeft();
 	}
 	return size;
 }
 
+/*
+	binary search the runs for the first one that ends at or after pos, then the block within the run is a divide
+	since every block in a run is the same size.  In the common case (partial head, full blocks, partial tail)
+	there are at most 3 runs so this is effectively constant time.
+*/
 template<typename BAllocator>
-typename SegmentedBuffer<BAllocator>::Position SegmentedBuffer<BAllocator>::findBlockIndex(uint32_t pos) const {
-	EncodeListTypeCIT it = EncodedCollection.begin();
-	uint32_t lastLoopLinearPos = 0;
-	uint32_t index = 0;
-	for(;it!=EncodedCollection.end();++it) {
-		uint32_t endLinear = (*it).BytesWritten*(((*it).endIndex-(*it).startIndex)+1) + lastLoopLinearPos;
-		if(pos>=lastLoopLinearPos && pos<=endLinear) {
-			uint32_t BucketSize = pos-lastLoopLinearPos;
-			index+= BucketSize/(*it).BytesWritten;
-			return Position(index,BucketSize%(*it).BytesWritten,this);
-		}
-		lastLoopLinearPos = endLinear;
-		index+=((*it).endIndex-(*it).startIndex)+1;
+typename SegmentedBuffer<BAllocator>::Position SegmentedBuffer<BAllocator>::findBlockIndex(pos_type pos) const {
+	EncodeListTypeCIT it = std::lower_bound(EncodedCollection.begin(),EncodedCollection.end(),pos,EncodedEndLess());
+	if(it==EncodedCollection.end()) {
+		return Position(Position::INVALID_INDEX,0,0);
 	}
-	return Position(Position::INVALID_INDEX,0,0);
+	if((*it).BytesWritten==0) {
+		return Position((*it).startIndex,0,this);
+	}
+	pos_type BucketSize = pos-(*it).startLinear;
+	return Position((*it).startIndex + index_type(BucketSize/(*it).BytesWritten),uint32_t(BucketSize%(*it).BytesWritten),this);
 }
 
 template<typename BAllocator>
@@ -428,23 +675,27 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::wri
 	Position WritePos  = Position::convertFromLinearPosition(writePos,this);
 	if(!WritePos.Is_Valid()) {
 		WritePos = getEnd();
+		writePos = Size();
 	}
 	size_type copiedTotal = 0;
 	size_type leftToCopy = inBufferSize;
-	size_type currentIndex = WritePos.Index;
-	size_type currentOffSet = WritePos.OffSet;
+	index_type currentIndex = WritePos.Index;
+	uint32_t currentOffSet = WritePos.OffSet;
 	while(leftToCopy>0) {
 		size_type copied = 0;
 		//do we need to allocate a new block
 		if(currentIndex>=BufferList.size()) {
-			BlockBuffer *bb = BAllocator::allocate();
+			BlockBuffer *bb = allocateBlock(writePos+copiedTotal);
+			AllocatedBytes += bb->allocatedSize();
 //			WSSLOG_ASSERTMSG(0,bb,"failed to allocate buffer");
 			BufferList.push_back(bb);
+		} else if(currentOffSet<BufferList[currentIndex]->capacity() && BufferList[currentIndex]->isShared()) {
+			unshare(currentIndex);
 		}
 		if(inBuffer) {
-			copied = BufferList[currentIndex++]->CopyFrom(currentOffSet,static_cast<const uint8_t*>(inBuffer)+copiedTotal,leftToCopy);
+			copied = BufferList[currentIndex++]->CopyFrom(currentOffSet,static_cast<const uint8_t*>(inBuffer)+copiedTotal,blockLength(leftToCopy));
 		} else { //passing null simply moves points to act like a "fill"
-			copied = BufferList[currentIndex++]->CopyFrom(currentOffSet,static_cast<const uint8_t*>(inBuffer),leftToCopy);
+			copied = BufferList[currentIndex++]->CopyFrom(currentOffSet,static_cast<const uint8_t*>(inBuffer),blockLength(leftToCopy));
 		}
 		copiedTotal += copied;
 		leftToCopy -= copied;
@@ -456,25 +707,138 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::wri
 			assert(BufferList[i]->bytesWritten()==BufferList[i]->capacity());
 		}
 #endif
-	EncodeBufferList();
+	EncodeBufferListFrom(WritePos.Index);
 	return inBufferSize;
 }
 
+/*
+	Reserve / commit:  lets a caller (i.e. a socket recv) write straight into the tail block rather than into a
+	temporary buffer that is then copied in with write.
+	If the tail does not have enough room we sync its capacity with bytes written (rule #4) so it is a
+	'full' block (rule #5) and start a new block, this way the caller always gets contiguous memory.
+*/
+template<typename BAllocator>
+void *SegmentedBuffer<BAllocator>::prepare(size_type sizeHint, uint32_t &outSize) {
+	//blocks sealed by earlier prepares are the waste, check before handing out the tail
+	maybeCompact();
+	BlockBuffer *tail = BufferList.back();
+	size_type wanted = (std::min)(sizeHint,size_type(nextBlockSize()));
+	if(tail->bytesLeft()==0 || tail->isShared() || (tail->bytesLeft()<wanted && !tail->isEmpty())) {
+		tail->syncCapacityWithBytesWritten();
+		BufferList.push_back(allocateBlock(Size()));
+		AllocatedBytes += BufferList.back()->allocatedSize();
+		EncodeBufferListFrom(index_type(BufferList.size()-1));
+		tail = BufferList.back();
+	}
+	outSize = tail->bytesLeft();
+	return tail->getWritePointer();
+}
+
+template<typename BAllocator>
+typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::commit(size_type length) {
+	BlockBuffer *tail = BufferList.back();
+	size_type committed = tail->CopyFrom(tail->bytesWritten(),0,blockLength(length));
+	EncodeBufferListFrom(index_type(BufferList.size()-1));
+	return committed;
+}
+
+/*
+	prepend:  the tail end of the bytes goes into the head block's headroom (if it isn't shared), whatever is left
+	goes into new blocks pushed on the front.  A new block is filled from its end back so it is 'full' (rule #5)
+	with the unused part in front of start, i.e. headroom for the next pushFront.  Only the runs for the blocks
+	touched are rebuilt
+*/
 template<typename BAllocator>
 typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::pushFront(const void *inBuffer, size_type inBufferSize) {
-	SegmentedBuffer sb;
-	sb.write(0,inBuffer,inBufferSize);
-	//set capacity and bytesWritten equal before we tail on current blocks
-	sb.BufferList[sb.BufferList.size()-1]->syncCapacityWithBytesWritten();
-	BufferListType::iterator it = BufferList.begin();
-	for(;it!=BufferList.end();++it) {
-		sb.BufferList.push_back((*it));
+	if(inBufferSize==0) {
+		return Size();
+	}
+	if(Size()==0 && BufferList.front()->headroom()==0) {
+		write(0,inBuffer,inBufferSize);
+		return Size();
+	}
+	const uint8_t *src = static_cast<const uint8_t*>(inBuffer);
+	size_type left = inBufferSize;
+	BlockBuffer *head = BufferList.front();
+	if(!head->isShared() && head->headroom()>0) {
+		uint32_t n = blockLength((std::min)(left,size_type(head->headroom())));
+		left -= n;
+		head->prepend(src+left,n);
+	}
+	index_type blocksAdded = 0;
+	while(left>0) {
+		BlockBuffer *bb = allocateBlock(left);
+		AllocatedBytes += bb->allocatedSize();
+		uint32_t n = blockLength((std::min)(left,size_type(bb->capacity())));
+		bb->reserveFront(bb->capacity());
+		left -= n;
+		bb->prepend(src+left,n);
+		BufferList.push_front(bb);
+		++blocksAdded;
+	}
+	EncodePushedFront(blocksAdded,inBufferSize);
+	return Size();
+}
+
+/*
+	adjust the runs after pushFront:  the old head (now at index blocksAdded) may have grown so it is split into
+	its own run, every run after it moves up by the blocks/bytes added, then runs for the new blocks and the old
+	head are built and put in front
+*/
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::EncodePushedFront(index_type blocksAdded, size_type bytesAdded) {
+	Encoded &first = EncodedCollection.front();
+	if(first.endIndex>first.startIndex) {
+		Encoded rest = first;
+		rest.startIndex++;
+		rest.startLinear += first.BytesWritten;
+		EncodedCollection.insert(EncodedCollection.begin()+1,rest);
+	}
+	EncodedCollection.erase(EncodedCollection.begin());
+	for(EncodeListTypeIT it=EncodedCollection.begin();it!=EncodedCollection.end();++it) {
+		(*it).startIndex += blocksAdded;
+		(*it).endIndex += blocksAdded;
+		(*it).startLinear += bytesAdded;
+	}
+	EncodeListType front;
+	for(index_type i=0;i<=blocksAdded;i++) {
+		uint32_t bytesWritten = BufferList[i]->bytesWritten();
+		if(!front.empty() && front.back().BytesWritten==bytesWritten) {
+			front.back().endIndex = i;
+		} else {
+			Encoded e;
+			e.endIndex = e.startIndex = i;
+			e.BytesWritten = bytesWritten;
+			e.startLinear = front.empty() ? 0 : front.back().endLinear();
+			front.push_back(e);
+		}
+	}
+	if(!EncodedCollection.empty() && EncodedCollection.front().BytesWritten==front.back().BytesWritten) {
+		EncodedCollection.front().startIndex = front.back().startIndex;
+		EncodedCollection.front().startLinear = front.back().startLinear;
+		front.pop_back();
+	}
+	EncodedCollection.insert(EncodedCollection.begin(),front.begin(),front.end());
+}
+
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::reserveHeadroom(uint32_t bytes) {
+	Headroom = bytes;
+	applyHeadroom();
+}
+
+/*
+	headroom only goes into an empty (so unshared, single block) buffer, never more than half the block so
+	appends still have room
+*/
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::applyHeadroom() {
+	BlockBuffer *head = BufferList.front();
+	if(Headroom>0 && BufferList.size()==1 && head->isEmpty() && !head->isShared()) {
+		head->reset();
+		head->reserveFront((std::min)(Headroom,head->capacity()/2));
+		EncodeBufferList();
 	}
-	BufferList.swap(sb.BufferList);
-	//TODO OPT
-	//could just update encoded list directly as we know we only pushed front
-	EncodeBufferList();
-	return this->BytesWritten();
 }
 
 template<typename BAllocator>
@@ -485,21 +849,27 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::era
 template<typename BAllocator>
 typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::erase(pos_type startPos, size_type lengthToErase)
 {
+	if(startPos==0) {
+		return consume(lengthToErase);
+	}
 	Position sPos = Position::convertFromLinearPosition(startPos,this);
 	Position ePos = Position::convertFromLinearPosition(startPos+lengthToErase,this);
+	if(!sPos.Is_Valid()) {
+		return 0;
+	}
 	if(!ePos.Is_Valid()) {
 		ePos = getEnd();
 	}
 #ifdef VALIDATE_SEGMENTED_BUFFER
 	//only valid in test cases
-	uint32_t validationLength = ePos.convertToLinearOffset()-sPos.convertToLinearOffset();
+	pos_type validationLength = ePos.convertToLinearOffset()-sPos.convertToLinearOffset();
 #endif
 	//total blocks to reserve
-	uint32_t numBlocks = uint32_t(BufferList.size()) - (ePos.Index-sPos.Index);
+	index_type numBlocks = index_type(BufferList.size()) - (ePos.Index-sPos.Index);
 	//reserve blocks
 	BufferListType newContainer(numBlocks,0), removedBlocks;
-	uint32_t index = 0;
-	uint32_t wIndex = 0;
+	index_type index = 0;
+	index_type wIndex = 0;
 	size_type erased = 0;
 	for(;index<BufferList.size();index++) {
 		if(wIndex>=newContainer.size()) {
@@ -512,10 +882,13 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::era
 		//we are removing from this block
 		else if(index==sPos.Index && index==ePos.Index) {
 			//we can erase the entire block
-			if(BufferList[index]->bytesWritten()<=lengthToErase) {
+			if(sPos.OffSet==0 && BufferList[index]->bytesWritten()<=lengthToErase) {
 				removedBlocks.push_back(BufferList[index]);
 				erased+=BufferList[index]->bytesWritten();
 			} else { //erase just part of this block
+				if(BufferList[index]->isShared()) {
+					unshare(index);
+				}
 				newContainer[wIndex] = BufferList[index];
 				newContainer[wIndex]->MemMove(sPos.OffSet,ePos.OffSet);
 				//if this is not the last buffer sync Capacity with bytes written
@@ -571,7 +944,15 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::era
 	//swap Container pointers
 	BufferList.swap(newContainer);
 	//free erased blocks
-	std::for_each(removedBlocks.begin(),removedBlocks.end(),&BAllocator::deallocate);
+	for(typename BufferListType::iterator it=removedBlocks.begin();it!=removedBlocks.end();++it) {
+		AllocatedBytes -= (*it)->allocatedSize();
+		BlockBuffer::release(*it);
+	}
+	//always keep a block to write into
+	if(BufferList.empty()) {
+		BufferList.push_back(allocateBlock(0));
+		AllocatedBytes += BufferList.back()->allocatedSize();
+	}
 
 #ifdef VALIDATE_SEGMENTED_BUFFER
 	for(uint32_t i=0;i<BufferList.size();i++)
@@ -579,10 +960,257 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::era
 		assert(BufferList[i]->bytesWritten()==BufferList[i]->capacity());
 	}
 #endif
-	EncodeBufferList();
+	//blocks before the start position are untouched
+	EncodeBufferListFrom(sPos.Index);
+	maybeCompact();
+	applyHeadroom();
+	return erased;
+}
+
+/*
+	erase from the front:  this is what a channel does after processing (or sending) bytes so it has its own path
+	rather than going through the general erase.
+		1.  whole blocks at the front are popped and freed
+		2.  the head block has its start pointer moved (rule #3a)
+		3.  if everything is consumed the last block is reset rather than freed so we always have a block to write to
+	no container is rebuilt and the encoded runs are adjusted in place, O(blocks removed + runs)
+*/
+template<typename BAllocator>
+typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::consume(size_type lengthToErase) {
+	size_type erased = 0;
+	size_type blocksRemoved = 0;
+	while(lengthToErase>0 && BufferList.size()>1 && BufferList.front()->bytesWritten()<=lengthToErase) {
+		BlockBuffer *bb = BufferList.front();
+		erased += bb->bytesWritten();
+		lengthToErase -= bb->bytesWritten();
+		BufferList.pop_front();
+		AllocatedBytes -= bb->allocatedSize();
+		BlockBuffer::release(bb);
+		++blocksRemoved;
+	}
+	size_type headErased = 0;
+	BlockBuffer *head = BufferList.front();
+	if(lengthToErase>0) {
+		headErased = (std::min)(lengthToErase,size_type(head->bytesWritten()));
+		head->setStart(uint32_t(headErased));
+		erased += headErased;
+	}
+	if(BufferList.size()==1 && head->isEmpty()) {
+		if(head->isShared()) {
+			//can't rewind into a payload someone else is reading, start a fresh block
+			AllocatedBytes -= head->allocatedSize();
+			BlockBuffer::release(head);
+			BufferList[0] = allocateBlock(0);
+			AllocatedBytes += BufferList[0]->allocatedSize();
+		} else {
+			head->reset();
+		}
+	}
+	EncodeConsumedFront(blocksRemoved,headErased,erased);
+	applyHeadroom();
 	return erased;
 }
 
+/*
+	adjust the runs after consume: drop runs for popped blocks, split the head block into its own run
+	if it shrank, then shift every run back by the number of blocks/bytes removed
+*/
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::EncodeConsumedFront(size_type blocksRemoved, size_type headBytesRemoved, size_type bytesRemoved) {
+	EncodeListTypeIT it = EncodedCollection.begin();
+	while(it!=EncodedCollection.end() && (*it).endIndex<blocksRemoved) {
+		++it;
+	}
+	EncodedCollection.erase(EncodedCollection.begin(),it);
+	if(EncodedCollection.empty()) {
+		EncodeBufferList();
+		return;
+	}
+	Encoded &first = EncodedCollection.front();
+	if(first.startIndex<blocksRemoved) {
+		first.startLinear += (blocksRemoved-first.startIndex)*first.BytesWritten;
+		first.startIndex = blocksRemoved;
+	}
+	if(headBytesRemoved>0) {
+		if(first.endIndex>first.startIndex) {
+			Encoded rest = first;
+			rest.startIndex++;
+			rest.startLinear += first.BytesWritten;
+			first.endIndex = first.startIndex;
+			EncodedCollection.insert(EncodedCollection.begin()+1,rest);
+		}
+		Encoded &head = EncodedCollection.front();
+		head.BytesWritten -= headBytesRemoved;
+		head.startLinear += headBytesRemoved;
+	}
+	for(it=EncodedCollection.begin();it!=EncodedCollection.end();++it) {
+		(*it).startIndex -= blocksRemoved;
+		(*it).endIndex -= blocksRemoved;
+		(*it).startLinear -= bytesRemoved;
+	}
+}
+
+/*
+	fan out:  the tail is sealed (rule #4) so it can't be appended into the shared payload, then each segment gets a
+	view header.  An empty tail is moved after the views rather than freed so the next write still has a block
+*/
+template<typename BAllocator>
+typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::appendShared(const SharedBuffer &sb) {
+	index_type firstChanged = index_type(BufferList.size()-1);
+	BlockBuffer *emptyTail = 0;
+	if(BufferList.back()->isEmpty()) {
+		emptyTail = BufferList.back();
+		BufferList.pop_back();
+		AllocatedBytes -= emptyTail->allocatedSize();
+		if(emptyTail->isShared()) {
+			BlockBuffer::release(emptyTail);
+			emptyTail = 0;
+		}
+	} else {
+		BufferList.back()->syncCapacityWithBytesWritten();
+	}
+	size_type appended = 0;
+	for(size_t i=0;i<sb.getSegmentCount();i++) {
+		const SharedBuffer::Segment &seg = sb.getSegment(i);
+		if(seg.Length>0) {
+			BufferList.push_back(BlockBuffer::createView(seg.Owner,seg.Data,seg.Length));
+			AllocatedBytes += seg.Length;
+			appended += seg.Length;
+		}
+	}
+	if(emptyTail) {
+		emptyTail->reset();
+		BufferList.push_back(emptyTail);
+		AllocatedBytes += emptyTail->allocatedSize();
+	} else if(BufferList.empty()) {
+		BufferList.push_back(allocateBlock(appended));
+		AllocatedBytes += BufferList.back()->allocatedSize();
+	}
+	EncodeBufferListFrom(firstChanged);
+	maybeCompact();
+	return appended;
+}
+
+/*
+	splice:  the range is walked as (leading partial block)(whole blocks)(trailing partial block).  The partial
+	blocks are copied onto the end of dst, the whole blocks are unlinked from this list and linked onto dst without
+	touching their bytes.  Once the whole blocks are gone the two partial pieces are adjacent at pos so a single
+	erase removes them
+*/
+template<typename BAllocator>
+typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::splice(SegmentedBuffer &dst, pos_type pos, size_type length) {
+	if(&dst==this || pos>=Size()) {
+		return 0;
+	}
+	length = (std::min)(length,Size()-pos);
+	if(length==0) {
+		return 0;
+	}
+	Position s = Position::convertFromLinearPosition(pos,this);
+	index_type index = s.Index;
+	uint32_t offSet = s.OffSet;
+	if(offSet>=BufferList[index]->bytesWritten()) {
+		//pos is on a block boundary, pos<Size() so there is a next block
+		++index;
+		offSet = 0;
+	}
+	size_type left = length;
+	size_type copied = 0;
+	BlockBuffer *bb = BufferList[index];
+	if(offSet>0 || bb->bytesWritten()>left) {
+		uint32_t n = blockLength((std::min)(left,size_type(bb->bytesWritten()-offSet)));
+		dst.write(dst.Size(),bb->getStart()+offSet,n);
+		left -= n;
+		copied += n;
+		++index;
+	}
+	index_type firstMoved = index;
+	while(left>0 && index<BufferList.size() && BufferList[index]->bytesWritten()<=left) {
+		left -= BufferList[index]->bytesWritten();
+		AllocatedBytes -= BufferList[index]->allocatedSize();
+		++index;
+	}
+	if(index>firstMoved) {
+		dst.appendBlocks(BufferList.begin()+firstMoved,BufferList.begin()+index);
+		BufferList.erase(BufferList.begin()+firstMoved,BufferList.begin()+index);
+		if(BufferList.empty()) {
+			BufferList.push_back(allocateBlock(0));
+			AllocatedBytes += BufferList.back()->allocatedSize();
+		}
+		EncodeBufferListFrom((std::min)(firstMoved,index_type(BufferList.size()-1)));
+	}
+	if(left>0) {
+		dst.write(dst.Size(),BufferList[firstMoved]->getStart(),blockLength(left));
+		copied += left;
+	}
+	if(copied>0) {
+		erase(pos,copied);
+	} else {
+		applyHeadroom();
+	}
+	return length;
+}
+
+/*
+	same idea as appendShared:  an empty tail is taken out so the new blocks follow the data and is put back after
+	them if the last new block is full, otherwise the last new block is the tail and has room to write into
+*/
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::appendBlocks(typename BufferListType::const_iterator first, typename BufferListType::const_iterator last) {
+	index_type firstChanged = index_type(BufferList.size()-1);
+	BlockBuffer *emptyTail = 0;
+	if(BufferList.back()->isEmpty()) {
+		emptyTail = BufferList.back();
+		BufferList.pop_back();
+		AllocatedBytes -= emptyTail->allocatedSize();
+	} else {
+		BufferList.back()->syncCapacityWithBytesWritten();
+	}
+	for(;first!=last;++first) {
+		BufferList.push_back(*first);
+		AllocatedBytes += (*first)->allocatedSize();
+	}
+	if(emptyTail) {
+		if(BufferList.back()->bytesLeft()==0 && !emptyTail->isShared()) {
+			emptyTail->reset();
+			BufferList.push_back(emptyTail);
+			AllocatedBytes += emptyTail->allocatedSize();
+		} else {
+			BlockBuffer::release(emptyTail);
+		}
+	}
+	EncodeBufferListFrom(firstChanged);
+	maybeCompact();
+}
+
+/*
+	take refs on the blocks covering pos to pos+length, the blocks are shared from here on so the tail is
+	sealed, anything written after this goes to a new block and any overwrite of these bytes copies first
+*/
+template<typename BAllocator>
+typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::share(pos_type pos, size_type length, SharedBuffer &out) {
+	Position s = Position::convertFromLinearPosition(pos,this);
+	size_type shared = 0;
+	if(s.Is_Valid()) {
+		index_type currentIndex = s.Index;
+		uint32_t currentOffSet = s.OffSet;
+		while(length>0 && currentIndex<BufferList.size()) {
+			BlockBuffer *bb = BufferList[currentIndex++];
+			if(currentOffSet<bb->bytesWritten()) {
+				size_type avail = (std::min)(size_type(bb->bytesWritten()-currentOffSet),length);
+				if(currentIndex==BufferList.size()) {
+					bb->syncCapacityWithBytesWritten();
+				}
+				out.append(bb,bb->getStart()+currentOffSet,uint32_t(avail));
+				length -= avail;
+				shared += avail;
+			}
+			currentOffSet = 0;
+		}
+	}
+	return shared;
+}
+
 template<typename BAllocator>
 typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::Capacity() const {
 #ifdef VALIDATE_SEGMENTED_BUFFER
@@ -632,7 +1260,95 @@ typename SegmentedBuffer<BAllocator>::size_type SegmentedBuffer<BAllocator>::res
 	return Size();
 }
 
+/*
+	compaction:  walk the blocks building a new list, a block that is at least a full block for its position is
+	moved over as is, anything smaller is copied into new blocks that are filled before the next one is started.
+	If a full block comes up while a new block is part filled, the new block is sealed (rule #4) rather than
+	copying every block after it, so the waste left is at most one part block per run of full blocks.
+	Shared blocks that are underfilled are copied like any other, the copy is private
+*/
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::compact() {
+	if(BufferList.size()<2) {
+		return;
+	}
+	BufferListType packed;
+	size_type packedBytes = 0;
+	size_type allocated = 0;
+	BlockBuffer *dest = 0;
+	for(index_type i=0;i<BufferList.size();i++) {
+		BlockBuffer *bb = BufferList[i];
+		bool last = i==(BufferList.size()-1);
+		if(bb->bytesWritten()>=blockSizeFor(packedBytes) || (last && !dest)) {
+			if(dest) {
+				dest->syncCapacityWithBytesWritten();
+				dest = 0;
+			}
+			packed.push_back(bb);
+			allocated += bb->allocatedSize();
+			packedBytes += bb->bytesWritten();
+			continue;
+		}
+		uint32_t copied = 0;
+		while(copied<bb->bytesWritten()) {
+			if(!dest) {
+				dest = allocateBlock(packedBytes);
+				packed.push_back(dest);
+				allocated += dest->allocatedSize();
+			}
+			uint32_t n = dest->CopyFrom(dest->bytesWritten(),bb->getStart()+copied,bb->bytesWritten()-copied);
+			copied += n;
+			packedBytes += n;
+			if(dest->bytesLeft()==0) {
+				dest = 0;
+			}
+		}
+		BlockBuffer::release(bb);
+	}
+	if(packed.empty()) {
+		packed.push_back(allocateBlock(0));
+		allocated += packed.back()->allocatedSize();
+	}
+	BufferList.swap(packed);
+	AllocatedBytes = allocated;
+	EncodeBufferList();
+}
+
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::shrinkToFit() {
+	compact();
+	BlockBuffer *tail = BufferList.back();
+	uint32_t used = tail->bytesWritten();
+	if(used>0 && tail->bytesLeft()>used) {
+		BlockBuffer *copy = BlockBuffer::allocateExact(used);
+		copy->CopyFrom(0,tail->getStart(),used);
+		BufferList.back() = copy;
+		AllocatedBytes -= tail->allocatedSize();
+		AllocatedBytes += copy->allocatedSize();
+		BlockBuffer::release(tail);
+		EncodeBufferListFrom(index_type(BufferList.size()-1));
+	}
+}
+
+template<typename BAllocator>
+float SegmentedBuffer<BAllocator>::getFillRatio() const {
+	return AllocatedBytes ? float(double(Capacity())/double(AllocatedBytes)) : 1.0f;
+}
+
+/*
+	the block count minimum keeps small buffers (where a part block or two is most of the memory) from
+	being repacked over and over
+*/
+template<typename BAllocator>
+void SegmentedBuffer<BAllocator>::maybeCompact() {
+	if(AutoCompactRatio>0 && BufferList.size()>=MIN_AUTO_COMPACT_BLOCKS && getFillRatio()<AutoCompactRatio) {
+		compact();
+	}
+}
+
 template class SegmentedBuffer<BlockBufferAllocator<4000> >;
 template class SegmentedBuffer<BlockBufferAllocator<64> >;
 template class SegmentedBuffer<BlockBufferAllocator<4060> >;
 template class SegmentedBuffer<BlockBufferAllocator<1024> >;
+template class SegmentedBuffer<PooledBlockBufferAllocator<4000> >;
+template class SegmentedBuffer<ArenaBlockBufferAllocator<4000> >;
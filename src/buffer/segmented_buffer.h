@@ -4,13 +4,29 @@
 #include <vector>
 #include <deque>
 #include <algorithm>
+#include <atomic>
 #include "../portable_types.h"
+#include "buffer_span.h"
 
 namespace wss {
 
+class SharedBuffer;
 
+/*
+	BlockBuffer:  header around a block of memory
+
+	The payload of a block can be shared by many block lists (i.e. one broadcast message in many channel out buffers):
+		1.  the block that owns the payload carries an intrusive ref count, it starts at 1 for whoever allocated it
+		2.  other lists get a 'view', a small header of their own pointing into the owner's payload, each view holds a
+			ref on the owner so start/end can move independently per list
+		3.  a shared payload is immutable, its end is sealed (syncCapacityWithBytesWritten) before it is shared and
+			anything that would write into it must copy it first (see SegmentedBuffer::unshare)
+		4.  blocks are freed with release() never delete, the owner goes back through the release function set by
+			whoever allocated it once the last ref is dropped
+*/
 class BlockBuffer {
 public:
+	typedef void (*ReleaseFunction)(BlockBuffer *);
 	//ctor to create this interface around a block of memory
 	BlockBuffer(uint8_t *buf, uint32_t size);
 	//swaps internal pointers
@@ -28,8 +44,18 @@ public:
 	void erase(uint32_t from);
 	//returns start pointer
 	const uint8_t* getStart() const;
+	//returns pointer to the first unwritten byte, bytesLeft() bytes can be written there
+	uint8_t* getWritePointer() {return deepestWrite;}
 	//sets start pointer within buffer, this does not change the allocated start pointer
 	void setStart(uint32_t pos);
+	//bytes between the allocated start and start, what prepend can use
+	uint32_t headroom() const {return static_cast<uint32_t>(start-allocatedStart);}
+	//copies len bytes in front of start and moves start back over them, len must be <= headroom()
+	void prepend(const uint8_t *fromBuffer, uint32_t len);
+	//empty block only, moves start and deepest write len bytes in so len bytes can be prepended later
+	void reserveFront(uint32_t len);
+	//moves start, deepest write and end back to the allocation so an emptied block can be reused at full size
+	void reset();
 	//set end = deepestWrite
 	void syncCapacityWithBytesWritten();
 	//returns the capacity of this buffer
@@ -38,16 +64,39 @@ public:
 	uint32_t bytesWritten() const;
 	//returns bytes free in this buffer (i.e. from deepestWrite to allocated end
 	uint32_t bytesLeft() const;
+	//payload size the block was created with, capacity() only ever shrinks from here
+	uint32_t allocatedSize() const {return allocated;}
 	//allows you to 'fill' the buffer
 	void fill();
-	//frees block
+	//returns the memory this block was constructed around, the allocator owns it
+	uint8_t *getAllocatedStart() const {return allocatedStart;}
+	//function the owner is handed to once its last ref is released
+	void setReleaseFunction(ReleaseFunction rf) {releaser = rf;}
+	void addRef();
+	//drops a ref, a view releases its owner, the owner goes to its release function when the count hits 0
+	static void release(BlockBuffer *bb);
+	//payload is referenced from more than one place and must not be written to
+	bool isShared() const;
+	bool isView() const {return parent!=0;}
+	//block that owns the payload this block points at
+	BlockBuffer *getOwner() {return parent ? parent : this;}
+	//sealed header over len bytes of owner's payload starting at data, takes a ref on owner
+	static BlockBuffer *createView(BlockBuffer *owner, const uint8_t *data, uint32_t len);
+	//header and exactly size bytes of payload in one heap allocation, for payloads that are not BLOCK_SIZE
+	static BlockBuffer *allocateExact(uint32_t size);
+	//does not free the memory, that is left to the allocator that handed out the block
 	~BlockBuffer();
 private:
-	uint8_t *allocatedStart; //never moved used for delete []
+	uint8_t *allocatedStart; //never moved used by the allocator to free the block
 	uint8_t *start; //moved if we erase from front of block
 	uint8_t *deepestWrite; //moved as we write into block
 	uint8_t *end; //moved if we erase from end or middle of block (moved towards start)
+	std::atomic<uint32_t> refCount; //refs on this block's payload, only meaningful for the owner
+	uint32_t allocated; //payload size at construction
+	BlockBuffer *parent; //owner of the payload if this is a view
+	ReleaseFunction releaser;
 private:
+	static void freeExact(BlockBuffer *bb);
 	SET_NO_COPY(BlockBuffer);
 };
 
@@ -59,13 +108,45 @@ public:
 		return new BlockBuffer(new uint8_t[BLOCKSIZE],BLOCKSIZE);
 	}
 	static void deallocate(BlockBuffer *buffer) {
+		uint8_t *mem = buffer->getAllocatedStart();
 		delete buffer;
+		delete [] mem;
 	}
 	BlockBufferAllocator() {}
 private:
 	SET_NO_COPY(BlockBufferAllocator);
 };
 
+/*
+	BlockSizePolicy:  how big a SegmentedBuffer makes each new block
+
+		FIXED		every block is BlockSize bytes, 0 means the BAllocator's BLOCK_SIZE
+		ADAPTIVE	blocks start at BlockSize and double (up to MaxBlockSize) as the buffer grows, a new block is about
+					as big as what is already buffered so a large payload takes O(log n) blocks not O(n)
+
+	A size equal to the BAllocator's BLOCK_SIZE comes from the BAllocator, the page sized classes (PAGE_4K, PAGE_16K,
+	PAGE_64K) each come from their own per thread pool, anything else is an exactly sized heap allocation.
+*/
+struct BlockSizePolicy {
+	enum PolicyType {
+		FIXED,
+		ADAPTIVE
+	};
+	static const uint32_t PAGE_4K = 4096;
+	static const uint32_t PAGE_16K = 16384;
+	static const uint32_t PAGE_64K = 65536;
+
+	PolicyType Type;
+	uint32_t BlockSize;
+	uint32_t MaxBlockSize;
+
+	BlockSizePolicy() : Type(FIXED), BlockSize(0), MaxBlockSize(0) {}
+	static BlockSizePolicy Fixed(uint32_t blockSize);
+	static BlockSizePolicy Adaptive(uint32_t firstBlockSize, uint32_t maxBlockSize);
+	//size of the next block for a buffer holding bufferSize bytes, 0 means the BAllocator's BLOCK_SIZE
+	uint32_t nextBlockSize(uint64_t bufferSize) const;
+};
+
 /*
 	@Author: Demetrius Comes
 	@date 8-15-11
@@ -74,14 +155,19 @@ private:
 	From the outside worlds perspective this should be treated as if its a contiguous array of memory, internally we keep a deque of blocks (size in bytes per block is determined by the BAllocator template parameter)
 
 	Rules used for blocks:
-		1.  BlockBuffers are allocated each block buffer has an contiguous arrary of memory of BAllocator::BLOCK_SIZE size
+		1.  BlockBuffers are allocated each block buffer has an contiguous arrary of memory, BAllocator::BLOCK_SIZE bytes unless
+			the BlockSizePolicy says otherwise (blocks in one buffer can be different sizes)
 		2.  writing into the buffer is done via a position, the position is translated into a index / offset set to look up internally where to read, write, erase, or splice at.
 		3.  From erase of less than 1 block:
-				a.  but encompasses offset 0 we move the 'start' pointer to the new position in the block buffer
+				a.  but encompasses offset 0 we move the 'start' pointer to the new position in the block buffer, the bytes
+					in front of start are headroom that pushFront can copy into without touching any other block
 				b.  does not encompass offset 0, we memmove bytes then move the deepest write and 'end' pointer
 
 		4.  No block has a 'whole' in it as an example: bytes 0 - 56 have data, 57-62 do not, byte 63 has data in a 64 byte block.  Instead we have data in 0-57, but now the capacity of the block is 57 bytes NOT 64 anymore.
+			The lost capacity is only given back by compact() / shrinkToFit() (or automatically, see setAutoCompact)
 		5.  Besides the last block - bytesWritten() for a BlockerBuffer must == Capacity for that blocker buffer (see #4)
+		6.  A copy is a copy on write snapshot:  it gets a view on every block (no bytes are copied) so from then on the
+			blocks are shared, whichever buffer writes into one first copies it (see BlockBuffer rule #3)
 
 	Size() = sum of bytesWritten for each BlockBuffer in this SegmentedBuffer
 	Capacity() = sum of capacity for each BlockBuffer in this SegmentedBuffer
@@ -92,61 +178,134 @@ template<typename BAllocator>
 class SegmentedBuffer {
 	typedef std::deque<BlockBuffer*> BufferListType;
 public:
-	typedef uint32_t size_type;
-	typedef uint32_t pos_type;
+	//sizes and positions in the buffer are 64 bit, a single block (and an offset in it) is always 32 bit
+	typedef uint64_t size_type;
+	typedef uint64_t pos_type;
+	typedef uint32_t index_type;
 	static const uint32_t BLOCK_SIZE = BAllocator::BLOCK_SIZE;
 private:
 	class Position {
 	public:
-		static const size_type INVALID_INDEX = 0xFFFFFFFF;
+		static const index_type INVALID_INDEX = 0xFFFFFFFF;
 		static Position convertFromLinearPosition(pos_type pos, const SegmentedBuffer *buf);
 		pos_type convertToLinearOffset() const;
 		bool operator>(const Position &p) const;
-		size_type Index;
-		pos_type OffSet;
+		index_type Index;
+		uint32_t OffSet;
 		bool Is_Valid();
 	private:
-		Position(size_type index, size_type offSet, const SegmentedBuffer *buf);
+		Position(index_type index, uint32_t offSet, const SegmentedBuffer *buf);
 		const SegmentedBuffer *SBuffer;
 		friend class SegmentedBuffer;
 	};
 public:
 	SegmentedBuffer();
+	explicit SegmentedBuffer(const BlockSizePolicy &policy);
+	//snapshot of sb, O(blocks) and no bytes copied (rule #6).  The snapshot can be handed to another thread,
+	//sb carries on being written on its own thread
 	SegmentedBuffer(const SegmentedBuffer &sb);
+	SegmentedBuffer &operator=(const SegmentedBuffer &sb);
 	~SegmentedBuffer();
+	void swap(SegmentedBuffer &sb);
 
 	const void *raw(pos_type pos, uint32_t &outSize) const ;
+	//fills spans with up to maxSpans pointers covering length bytes starting at pos, returns number of spans filled
+	size_type getSpans(pos_type pos, size_type length, ConstBufferSpan *spans, size_type maxSpans) const;
 
 	size_type read(pos_type readPos, void *outBuff, size_type outBufferSize);
 	size_type read(pos_type readPos, void *outBuff, size_type outBufferSize, char delim, bool &wasDelimHit);
+	//linear position of the first delim at or after pos, nothing is copied
+	bool findDelim(pos_type pos, char delim, pos_type &delimPos) const;
 
 	size_type getBlockCount();
 	size_type write(pos_type writePos, const void *inBuffer, size_type inBufferSize);
+	//returns writable memory at the end of the buffer, outSize is the contiguous bytes available
+	//if the tail block has less than min(sizeHint,BLOCK_SIZE) bytes free a new block is started
+	void *prepare(size_type sizeHint, uint32_t &outSize);
+	//marks length bytes handed out by prepare as written
+	size_type commit(size_type length);
+	//prepends into the head block's headroom then into new blocks filled from their end, O(inBufferSize)
 	size_type pushFront(const void *inBuffer, size_type inBufferSize);
+	//keep bytes of headroom in front of the data whenever the buffer is empty (now and each time it is emptied)
+	//so a header pushed in front of a message doesn't need a block of its own, 0 turns it off
+	void reserveHeadroom(uint32_t bytes);
 	size_type resize(size_type size);
 
 	size_type erase(pos_type endPos) ;
 
 	size_type erase(pos_type startPos, size_type lengthToErase) ;
+	//erase from the front of the buffer, pops whole blocks and moves the start of the head block
+	size_type consume(size_type lengthToErase);
+	//appends views on the shared payload, no bytes are copied.  The current tail is sealed first
+	size_type appendShared(const SharedBuffer &sb);
+	//adds refs on the blocks covering length bytes from pos to out, no bytes are copied.
+	//the tail block is sealed so later writes go to a new block
+	size_type share(pos_type pos, size_type length, SharedBuffer &out);
+	//moves length bytes at pos to the end of dst and erases them here.  Blocks wholly inside the range change
+	//lists by pointer, only the partial blocks at either edge are copied.  Returns bytes moved
+	size_type splice(SegmentedBuffer &dst, pos_type pos, size_type length);
 	size_type Capacity() const;
 	size_type BytesWritten() const;
 	size_type Size() const;
+	const BlockSizePolicy &getBlockSizePolicy() const {return SizePolicy;}
+	//repack so every block but the tail is a full block, underfilled blocks are copied together and released
+	void compact();
+	//compact, then swap a mostly empty tail for an exactly sized copy.  Blocks freed to a pooled allocator stay
+	//in its cache, trim the allocator too to give the memory back
+	void shrinkToFit();
+	//compact when getFillRatio() drops below minFillRatio (checked after erase and when a block is sealed), 0 is off
+	void setAutoCompact(float minFillRatio) {AutoCompactRatio = minFillRatio;}
+	//Capacity() over the payload bytes allocated for the blocks in the list, 1.0 means nothing lost to rule #4
+	float getFillRatio() const;
+	size_type getAllocatedBytes() const {return AllocatedBytes;}
+	//size of the block the next append past the tail will get
+	uint32_t nextBlockSize() const {return blockSizeFor(Size());}
 
 protected:
 	Position getEnd();
 	void EncodeBufferList();
+	void EncodeBufferListFrom(index_type index);
+	void EncodeConsumedFront(size_type blocksRemoved, size_type headBytesRemoved, size_type bytesRemoved);
+	void EncodePushedFront(index_type blocksAdded, size_type bytesAdded);
+	void applyHeadroom();
+	//takes over the blocks in [first,last) as the new tail, the current tail is sealed
+	void appendBlocks(typename BufferListType::const_iterator first, typename BufferListType::const_iterator last);
 	size_type EncodeSize() const;
-	void UpdateEncodeEnd();
 	size_type EncodeSize(bool forCapacity) const;
-	Position findBlockIndex(uint32_t pos) const;
+	Position findBlockIndex(pos_type pos) const;
+	uint32_t blockSizeFor(size_type bufferSize) const;
+	void maybeCompact();
+	//new block for a buffer holding bufferSize bytes, sized by the policy
+	BlockBuffer *allocateBlock(size_type bufferSize) const;
+	static BlockBuffer *allocateBlockOfSize(uint32_t size);
+	template<typename A> static BlockBuffer *allocateFrom();
+	//replace a shared block with a private copy so it can be written to
+	void unshare(index_type index);
+	//a length to hand to a BlockBuffer, no block holds more than 4GB so anything bigger is clamped
+	static uint32_t blockLength(size_type length) {return length>0xFFFFFFFF ? 0xFFFFFFFF : uint32_t(length);}
 private:
 	BufferListType BufferList;
+	BlockSizePolicy SizePolicy;
+	size_type AllocatedBytes; //sum of allocatedSize() for every block in BufferList
+	float AutoCompactRatio;
+	uint32_t Headroom;
+	static const uint32_t MIN_AUTO_COMPACT_BLOCKS = 4;
 private:
+	/*
+		run of consecutive blocks with the same number of bytes written
+		startLinear is the linear position of the first byte of the run, this lets findBlockIndex
+		binary search the runs rather than summing them up on every lookup
+	*/
 	struct Encoded {
-		uint32_t startIndex;
-		uint32_t endIndex;
+		index_type startIndex;
+		index_type endIndex;
 		uint32_t BytesWritten;
-		Encoded() : startIndex(0), endIndex(0), BytesWritten(0) {}
+		pos_type startLinear;
+		Encoded() : startIndex(0), endIndex(0), BytesWritten(0), startLinear(0) {}
+		pos_type endLinear() const {return startLinear + pos_type(BytesWritten)*((endIndex-startIndex)+1);}
+	};
+	struct EncodedEndLess {
+		bool operator()(const Encoded &e, pos_type pos) const {return e.endLinear()<pos;}
 	};
 	typedef std::vector<Encoded> EncodeListType;
 	typedef typename EncodeListType::iterator EncodeListTypeIT;
@@ -12,10 +12,26 @@ IReaderWriter * SegmentedReaderWriterImpl::Create( ) {
 	return new SegmentedReaderWriterImpl();
 }
 
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::Create -- segmented buffer whose blocks are sized by policy
+* 
+*********************************************************************************************/
+IReaderWriter * SegmentedReaderWriterImpl::Create( const BlockSizePolicy &policy ) {
+	return new SegmentedReaderWriterImpl(policy);
+}
+
 SegmentedReaderWriterImpl::SegmentedReaderWriterImpl() : Stream() {
 
 }
 
+SegmentedReaderWriterImpl::SegmentedReaderWriterImpl(const BlockSizePolicy &policy) : Stream(policy) {
+
+}
+
+SegmentedReaderWriterImpl::SegmentedReaderWriterImpl(const SegmentedReaderWriterImpl &other) : IReaderWriter(), Stream(other.Stream) {
+
+}
+
 
 SegmentedReaderWriterImpl::~SegmentedReaderWriterImpl() {
 
@@ -50,6 +66,14 @@ size_t SegmentedReaderWriterImpl::erase(size_t pos, size_t length) {
 	return Stream.erase(pos,length);
 }
 
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::consume -- erases length bytes from the front of the segmented buffer
+* 
+*********************************************************************************************/
+size_t SegmentedReaderWriterImpl::consume(size_t length) {
+	return Stream.consume(length);
+}
+
 
 /**********************************************************************************************
 * SegmentedReaderWriterImpl::Size -- retursn size of segmented buffer (bytes written)
@@ -68,8 +92,12 @@ size_t SegmentedReaderWriterImpl::capacity() const {
 	return Stream.Capacity();
 }
 
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::getPreferredBlockSize -- size of the block the next append will get
+* 
+*********************************************************************************************/
 size_t SegmentedReaderWriterImpl::getPreferredBlockSize() const {
-	return ReservedSizeSegmentedBuffer::BLOCK_SIZE;
+	return Stream.nextBlockSize();
 }
 
 
@@ -83,7 +111,93 @@ bool SegmentedReaderWriterImpl::fixedCapacity() const {
 
 //Get raw pointer to data
 const void * SegmentedReaderWriterImpl::raw(size_t idx, size_t& out_length) const {
-	return Stream.raw(idx,(uint32_t &)out_length);
+	uint32_t len = 0;
+	const void *p = Stream.raw(idx,len);
+	out_length = len;
+	return p;
+}
+
+//Find delim without copying
+bool SegmentedReaderWriterImpl::findDelim(size_t pos, char delim, size_t &delimPos) const {
+	PooledSegmentedBuffer::pos_type found = 0;
+	if(Stream.findDelim(pos,delim,found)) {
+		delimPos = found;
+		return true;
+	}
+	return false;
+}
+
+//Get raw pointers to length bytes of data, one span per block
+size_t SegmentedReaderWriterImpl::rawSpans(size_t idx, size_t length, ConstBufferSpan *spans, size_t maxSpans) const {
+	return Stream.getSpans(idx,length,spans,maxSpans);
+}
+
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::prepare -- hands out free space in the tail block
+* 
+*********************************************************************************************/
+void * SegmentedReaderWriterImpl::prepare(size_t length, size_t& out_length) {
+	uint32_t len = 0;
+	void *p = Stream.prepare(length,len);
+	out_length = len;
+	return p;
+}
+
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::commit -- marks bytes written into space handed out by prepare
+* 
+*********************************************************************************************/
+size_t SegmentedReaderWriterImpl::commit(size_t length) {
+	return Stream.commit(length);
+}
+
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::prepend -- pushes bytes in front of the head block, into its headroom
+*	when there is some
+* 
+*********************************************************************************************/
+size_t SegmentedReaderWriterImpl::prepend(const void * src, size_t length) {
+	Stream.pushFront(src,length);
+	return length;
+}
+
+void SegmentedReaderWriterImpl::reserveHeadroom(uint32_t bytes) {
+	Stream.reserveHeadroom(bytes);
+}
+
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::appendShared -- appends views on the shared blocks, nothing is copied
+* 
+*********************************************************************************************/
+size_t SegmentedReaderWriterImpl::appendShared(const SharedBuffer &sb) {
+	return Stream.appendShared(sb);
+}
+
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::splice -- hands whole blocks to dst if it is segmented too, copies otherwise
+* 
+*********************************************************************************************/
+size_t SegmentedReaderWriterImpl::splice(IReaderWriter &dst, size_t pos, size_t length) {
+	SegmentedReaderWriterImpl *other = dynamic_cast<SegmentedReaderWriterImpl*>(&dst);
+	if(other) {
+		return Stream.splice(other->Stream,pos,length);
+	}
+	return IReaderWriter::splice(dst,pos,length);
 }
 
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::snapshot -- copy on write copy of the segmented buffer, no bytes are copied
+* 
+*********************************************************************************************/
+IReaderWriter *SegmentedReaderWriterImpl::snapshot() const {
+	return new SegmentedReaderWriterImpl(*this);
+}
+
+/**********************************************************************************************
+* SegmentedReaderWriterImpl::shrinkToFit -- repacks underfilled blocks and trims the tail block
+* 
+*********************************************************************************************/
+void SegmentedReaderWriterImpl::shrinkToFit() {
+	Stream.shrinkToFit();
+}
 
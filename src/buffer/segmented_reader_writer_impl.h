@@ -4,7 +4,7 @@
 #pragma once
 
 
-#include "segmented_buffer.h"
+#include "pooled_block_allocator.h"
 #include "../io/ireaderwriter.h"
 
 namespace wss {
@@ -12,14 +12,17 @@ class SegmentedReaderWriterImpl : public IReaderWriter
 {
 public:
 	static IReaderWriter * Create();
+	static IReaderWriter * Create(const BlockSizePolicy &policy);
 protected:
 	SegmentedReaderWriterImpl();
+	SegmentedReaderWriterImpl(const BlockSizePolicy &policy);
 public:
 	virtual ~SegmentedReaderWriterImpl();
 	virtual size_t read(size_t pos, void * dst, size_t length);
   virtual size_t readUntilDelim(size_t pos, void * dst, size_t length, char delim, bool &wasDelimHit);
 	virtual size_t write(size_t pos, const void * src, size_t length);
 	virtual size_t erase(size_t pos, size_t length);
+	virtual size_t consume(size_t length);
 
 	virtual size_t size() const;
 	virtual size_t capacity() const;
@@ -28,8 +31,20 @@ public:
 
 	//Get raw pointer to data
 	virtual const void * raw(size_t idx, size_t& out_length) const;
+	virtual bool findDelim(size_t pos, char delim, size_t &delimPos) const;
+	virtual size_t rawSpans(size_t idx, size_t length, ConstBufferSpan *spans, size_t maxSpans) const;
+	virtual void * prepare(size_t length, size_t& out_length);
+	virtual size_t commit(size_t length);
+	virtual size_t prepend(const void * src, size_t length);
+	virtual void reserveHeadroom(uint32_t bytes);
+	virtual size_t appendShared(const SharedBuffer &sb);
+	virtual size_t splice(IReaderWriter &dst, size_t pos, size_t length);
+	virtual void shrinkToFit();
+	virtual IReaderWriter *snapshot() const;
+protected:
+	SegmentedReaderWriterImpl(const SegmentedReaderWriterImpl &other);
 private:
-	ReservedSizeSegmentedBuffer Stream;
+	PooledSegmentedBuffer Stream;
 };
 
 
@@ -0,0 +1,64 @@
+#include "shared_buffer.h"
+
+using namespace wss;
+
+SharedBuffer::SharedBuffer() : Segments(), Size(0) {
+
+}
+
+/**********************************************************************************************
+* SharedBuffer::SharedBuffer -- the one copy of the payload, blocks are capped so capacity fits a uint32
+*
+*********************************************************************************************/
+SharedBuffer::SharedBuffer(const void *data, size_t len) : Segments(), Size(0) {
+	static const size_t MAX_SEGMENT = 0x40000000;
+	const uint8_t *src = static_cast<const uint8_t*>(data);
+	while(len>0) {
+		uint32_t chunk = uint32_t(len>MAX_SEGMENT ? MAX_SEGMENT : len);
+		BlockBuffer *bb = BlockBuffer::allocateExact(chunk);
+		bb->CopyFrom(0,src,chunk);
+		append(bb,bb->getStart(),chunk);
+		//append took its own ref
+		BlockBuffer::release(bb);
+		src += chunk;
+		len -= chunk;
+	}
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer &sb) : Segments(), Size(0) {
+	(*this) = sb;
+}
+
+SharedBuffer &SharedBuffer::operator=(const SharedBuffer &sb) {
+	if(this!=&sb) {
+		clear();
+		for(size_t i=0;i<sb.Segments.size();i++) {
+			append(sb.Segments[i].Owner,sb.Segments[i].Data,sb.Segments[i].Length);
+		}
+	}
+	return *this;
+}
+
+SharedBuffer::~SharedBuffer() {
+	clear();
+}
+
+void SharedBuffer::append(BlockBuffer *owner, const uint8_t *data, uint32_t len) {
+	//always hold the block that owns the payload, never another list's view
+	owner = owner->getOwner();
+	owner->addRef();
+	Segment s;
+	s.Owner = owner;
+	s.Data = data;
+	s.Length = len;
+	Segments.push_back(s);
+	Size += len;
+}
+
+void SharedBuffer::clear() {
+	for(size_t i=0;i<Segments.size();i++) {
+		BlockBuffer::release(Segments[i].Owner);
+	}
+	Segments.clear();
+	Size = 0;
+}
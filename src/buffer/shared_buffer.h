@@ -0,0 +1,45 @@
+#ifndef WSS_SHARED_BUFFER_H
+#define WSS_SHARED_BUFFER_H
+
+#include <vector>
+#include "segmented_buffer.h"
+
+namespace wss {
+
+/*
+	SharedBuffer:  immutable payload held as refs on one or more blocks
+
+	Built once (a single copy of the bytes, or no copy when taken from a SegmentedBuffer with share()) then appended
+	to any number of SegmentedBuffers with appendShared, each of which only gets a view header per block.
+	Refs are atomic so a SharedBuffer (and the buffers it was appended to) can be released on any thread.
+*/
+class SharedBuffer {
+public:
+	struct Segment {
+		BlockBuffer *Owner;
+		const uint8_t *Data;
+		uint32_t Length;
+	};
+public:
+	SharedBuffer();
+	//copies len bytes once into a block sized to fit
+	SharedBuffer(const void *data, size_t len);
+	SharedBuffer(const SharedBuffer &sb);
+	SharedBuffer &operator=(const SharedBuffer &sb);
+	~SharedBuffer();
+	//adds len bytes at data in owner's payload, takes a ref on owner
+	void append(BlockBuffer *owner, const uint8_t *data, uint32_t len);
+	//drops every ref
+	void clear();
+	size_t size() const {return Size;}
+	bool empty() const {return Size==0;}
+	size_t getSegmentCount() const {return Segments.size();}
+	const Segment &getSegment(size_t i) const {return Segments[i];}
+private:
+	std::vector<Segment> Segments;
+	size_t Size;
+};
+
+}
+
+#endif
@@ -0,0 +1,364 @@
+#include "spsc_reader_writer_impl.h"
+#include <cstring>
+#include <algorithm>
+#include <new>
+
+using namespace wss;
+
+/**********************************************************************************************
+* SPSCQueue::Create -- new queue, producer and consumer streams share it
+* 
+*********************************************************************************************/
+void SPSCQueue::Create(IReaderWriter *&producer, IReaderWriter *&consumer, uint64_t maxQueued, uint32_t blockSize) {
+	std::shared_ptr<SPSCQueue> queue(new SPSCQueue(maxQueued,blockSize));
+	producer = new SPSCProducerReaderWriterImpl(queue);
+	consumer = new SPSCConsumerReaderWriterImpl(queue);
+}
+
+SPSCQueue::SPSCQueue(uint64_t maxQueued, uint32_t blockSize) : MaxQueued(maxQueued), BlockSize(blockSize ? blockSize : DEFAULT_BLOCK_SIZE)
+	, Written(0), Tail(0), TailUsed(0), Produced(0), Consumed(0), Head(0), ConsumedLocal(0), Spare(0) {
+	Head = Tail = newBlock(0);
+}
+
+SPSCQueue::~SPSCQueue() {
+	while(Head) {
+		Block *next = Head->Next.load(std::memory_order_relaxed);
+		freeBlock(Head);
+		Head = next;
+	}
+	Block *spare = Spare.load(std::memory_order_relaxed);
+	if(spare) {
+		freeBlock(spare);
+	}
+}
+
+/**********************************************************************************************
+* SPSCQueue::newBlock -- block starting at linear position start, the spare if the consumer left one
+* 
+*********************************************************************************************/
+SPSCQueue::Block *SPSCQueue::newBlock(uint64_t start) {
+	Block *b = Spare.exchange(0,std::memory_order_acquire);
+	if(!b) {
+		void *mem = ::operator new(sizeof(Block)+BlockSize);
+		b = new (mem) Block;
+	}
+	b->Next.store(0,std::memory_order_relaxed);
+	b->Start = start;
+	b->Length = 0;
+	return b;
+}
+
+void SPSCQueue::freeBlock(Block *b) {
+	b->~Block();
+	::operator delete(static_cast<void*>(b));
+}
+
+void SPSCQueue::recycle(Block *b) {
+	Block *expected = 0;
+	if(!Spare.compare_exchange_strong(expected,b,std::memory_order_acq_rel)) {
+		freeBlock(b);
+	}
+}
+
+uint64_t SPSCQueue::room() const {
+	if(MaxQueued==0) {
+		return ~uint64_t(0);
+	}
+	uint64_t queued = Produced-Consumed.load(std::memory_order_acquire);
+	return queued<MaxQueued ? MaxQueued-queued : 0;
+}
+
+/**********************************************************************************************
+* SPSCQueue::write -- copy into the tail block, linking new blocks as they fill, then publish
+*
+* Returns: bytes written, less than length only if the queue is bounded and full
+*
+*********************************************************************************************/
+size_t SPSCQueue::write(const void *src, size_t length) {
+	length = size_t((std::min)(uint64_t(length),room()));
+	const uint8_t *from = static_cast<const uint8_t*>(src);
+	size_t done = 0;
+	while(done<length) {
+		if(TailUsed==BlockSize) {
+			Block *b = newBlock(Tail->Start+TailUsed);
+			Tail->Length = TailUsed;
+			Tail->Next.store(b,std::memory_order_release);
+			Tail = b;
+			TailUsed = 0;
+		}
+		uint32_t n = uint32_t((std::min)(size_t(BlockSize-TailUsed),length-done));
+		memcpy(Tail->data()+TailUsed,from+done,n);
+		TailUsed += n;
+		done += n;
+	}
+	Produced += done;
+	Written.store(Produced,std::memory_order_release);
+	return done;
+}
+
+/**********************************************************************************************
+* SPSCQueue::prepare -- room at the end of the tail block, a new block if the tail has less than
+*	min(length,block size) left.  Nothing is visible to the consumer until commit
+* 
+*********************************************************************************************/
+void *SPSCQueue::prepare(size_t length, size_t &out_length) {
+	uint64_t r = room();
+	out_length = 0;
+	if(r==0) {
+		return 0;
+	}
+	size_t wanted = (std::min)(length,size_t(BlockSize));
+	if(TailUsed==BlockSize || (TailUsed>0 && BlockSize-TailUsed<wanted)) {
+		Block *b = newBlock(Tail->Start+TailUsed);
+		Tail->Length = TailUsed;
+		Tail->Next.store(b,std::memory_order_release);
+		Tail = b;
+		TailUsed = 0;
+	}
+	out_length = size_t((std::min)(uint64_t(BlockSize-TailUsed),r));
+	return Tail->data()+TailUsed;
+}
+
+size_t SPSCQueue::commit(size_t length) {
+	length = (std::min)(length,size_t(BlockSize-TailUsed));
+	TailUsed += uint32_t(length);
+	Produced += length;
+	Written.store(Produced,std::memory_order_release);
+	return length;
+}
+
+uint64_t SPSCQueue::available() const {
+	return Written.load(std::memory_order_acquire)-ConsumedLocal;
+}
+
+/*
+	walk from the head, a block whose Next is not set yet is the producer's tail and holds everything from its
+	Start up to Written
+*/
+SPSCQueue::Block *SPSCQueue::find(uint64_t pos) const {
+	Block *b = Head;
+	for(;;) {
+		Block *next = b->Next.load(std::memory_order_acquire);
+		if(!next || pos<b->Start+b->Length) {
+			return b;
+		}
+		b = next;
+	}
+}
+
+uint64_t SPSCQueue::contiguous(const Block *b, uint64_t pos, uint64_t written) {
+	uint64_t end = written;
+	if(b->Next.load(std::memory_order_acquire)) {
+		end = (std::min)(end,b->Start+b->Length);
+	}
+	return end>pos ? end-pos : 0;
+}
+
+size_t SPSCQueue::read(uint64_t pos, void *dst, size_t length) const {
+	uint64_t written = Written.load(std::memory_order_acquire);
+	uint64_t linear = ConsumedLocal+pos;
+	if(linear>=written) {
+		return 0;
+	}
+	length = size_t((std::min)(uint64_t(length),written-linear));
+	uint8_t *to = static_cast<uint8_t*>(dst);
+	size_t done = 0;
+	Block *b = find(linear);
+	while(done<length) {
+		size_t n = size_t((std::min)(contiguous(b,linear,written),uint64_t(length-done)));
+		memcpy(to+done,b->data()+(linear-b->Start),n);
+		done += n;
+		linear += n;
+		if(done<length) {
+			b = b->Next.load(std::memory_order_acquire);
+		}
+	}
+	return done;
+}
+
+/*
+	same as read but stops in front of delim, wasDelimHit tells the caller it was found
+*/
+size_t SPSCQueue::readUntilDelim(uint64_t pos, void *dst, size_t length, char delim, bool &wasDelimHit) const {
+	uint64_t written = Written.load(std::memory_order_acquire);
+	uint64_t linear = ConsumedLocal+pos;
+	wasDelimHit = false;
+	if(linear>=written) {
+		return 0;
+	}
+	length = size_t((std::min)(uint64_t(length),written-linear));
+	uint8_t *to = static_cast<uint8_t*>(dst);
+	size_t done = 0;
+	Block *b = find(linear);
+	while(done<length) {
+		size_t n = size_t((std::min)(contiguous(b,linear,written),uint64_t(length-done)));
+		const uint8_t *from = b->data()+(linear-b->Start);
+		const void *hit = memchr(from,delim,n);
+		if(hit) {
+			n = static_cast<const uint8_t*>(hit)-from;
+			wasDelimHit = true;
+		}
+		memcpy(to+done,from,n);
+		done += n;
+		linear += n;
+		if(wasDelimHit) {
+			break;
+		}
+		if(done<length) {
+			b = b->Next.load(std::memory_order_acquire);
+		}
+	}
+	return done;
+}
+
+const void *SPSCQueue::raw(uint64_t pos, size_t &out_length) const {
+	uint64_t written = Written.load(std::memory_order_acquire);
+	uint64_t linear = ConsumedLocal+pos;
+	out_length = 0;
+	if(linear>=written) {
+		return 0;
+	}
+	Block *b = find(linear);
+	out_length = size_t(contiguous(b,linear,written));
+	return b->data()+(linear-b->Start);
+}
+
+/**********************************************************************************************
+* SPSCQueue::consume -- release bytes from the front, blocks the producer has moved past are
+*	unlinked and recycled
+*
+* Returns: bytes consumed, no more than available()
+*
+*********************************************************************************************/
+size_t SPSCQueue::consume(size_t length) {
+	length = size_t((std::min)(uint64_t(length),available()));
+	ConsumedLocal += length;
+	for(;;) {
+		Block *next = Head->Next.load(std::memory_order_acquire);
+		if(!next || ConsumedLocal<Head->Start+Head->Length) {
+			break;
+		}
+		recycle(Head);
+		Head = next;
+	}
+	Consumed.store(ConsumedLocal,std::memory_order_release);
+	return length;
+}
+
+SPSCProducerReaderWriterImpl::SPSCProducerReaderWriterImpl(const std::shared_ptr<SPSCQueue> &queue) : Queue(queue) {
+	EagerCommit = true;
+}
+
+SPSCProducerReaderWriterImpl::~SPSCProducerReaderWriterImpl() {
+}
+
+size_t SPSCProducerReaderWriterImpl::read(size_t /*pos*/, void * /*dst*/, size_t /*length*/) {
+	return 0;
+}
+
+size_t SPSCProducerReaderWriterImpl::readUntilDelim(size_t /*pos*/, void * /*dst*/, size_t /*length*/, char /*delim*/, bool &wasDelimHit) {
+	wasDelimHit = false;
+	return 0;
+}
+
+/**********************************************************************************************
+* SPSCProducerReaderWriterImpl::write -- append only, pos must be size()
+* 
+*********************************************************************************************/
+size_t SPSCProducerReaderWriterImpl::write(size_t pos, const void * src, size_t length) {
+	if(pos!=Queue->produced()) {
+		return 0;
+	}
+	return Queue->write(src,length);
+}
+
+size_t SPSCProducerReaderWriterImpl::erase(size_t /*pos*/, size_t /*length*/) {
+	return 0;
+}
+
+size_t SPSCProducerReaderWriterImpl::size() const {
+	return size_t(Queue->produced());
+}
+
+/**********************************************************************************************
+* SPSCProducerReaderWriterImpl::capacity -- bounded queue:  where writes have to stop until the
+*	consumer catches up
+* 
+*********************************************************************************************/
+size_t SPSCProducerReaderWriterImpl::capacity() const {
+	if(Queue->bounded()) {
+		return size_t(Queue->produced()+Queue->room());
+	}
+	return size_t(Queue->produced());
+}
+
+bool SPSCProducerReaderWriterImpl::fixedCapacity() const {
+	return Queue->bounded();
+}
+
+size_t SPSCProducerReaderWriterImpl::getPreferredBlockSize() const {
+	return Queue->getBlockSize();
+}
+
+const void * SPSCProducerReaderWriterImpl::raw(size_t /*idx*/, size_t& out_length) const {
+	out_length = 0;
+	return 0;
+}
+
+void * SPSCProducerReaderWriterImpl::prepare(size_t length, size_t& out_length) {
+	return Queue->prepare(length,out_length);
+}
+
+size_t SPSCProducerReaderWriterImpl::commit(size_t length) {
+	return Queue->commit(length);
+}
+
+SPSCConsumerReaderWriterImpl::SPSCConsumerReaderWriterImpl(const std::shared_ptr<SPSCQueue> &queue) : Queue(queue) {
+}
+
+SPSCConsumerReaderWriterImpl::~SPSCConsumerReaderWriterImpl() {
+}
+
+size_t SPSCConsumerReaderWriterImpl::read(size_t pos, void * dst, size_t length) {
+	return Queue->read(pos,dst,length);
+}
+
+size_t SPSCConsumerReaderWriterImpl::readUntilDelim(size_t pos, void * dst, size_t length, char delim, bool &wasDelimHit) {
+	return Queue->readUntilDelim(pos,dst,length,delim,wasDelimHit);
+}
+
+size_t SPSCConsumerReaderWriterImpl::write(size_t /*pos*/, const void * /*src*/, size_t /*length*/) {
+	return 0;
+}
+
+/**********************************************************************************************
+* SPSCConsumerReaderWriterImpl::erase -- only from the front
+* 
+*********************************************************************************************/
+size_t SPSCConsumerReaderWriterImpl::erase(size_t pos, size_t length) {
+	return pos==0 ? Queue->consume(length) : 0;
+}
+
+size_t SPSCConsumerReaderWriterImpl::consume(size_t length) {
+	return Queue->consume(length);
+}
+
+size_t SPSCConsumerReaderWriterImpl::size() const {
+	return size_t(Queue->available());
+}
+
+size_t SPSCConsumerReaderWriterImpl::capacity() const {
+	return size_t(Queue->available());
+}
+
+bool SPSCConsumerReaderWriterImpl::fixedCapacity() const {
+	return true;
+}
+
+size_t SPSCConsumerReaderWriterImpl::getPreferredBlockSize() const {
+	return Queue->getBlockSize();
+}
+
+const void * SPSCConsumerReaderWriterImpl::raw(size_t idx, size_t& out_length) const {
+	return Queue->raw(idx,out_length);
+}
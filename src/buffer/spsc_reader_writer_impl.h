@@ -0,0 +1,146 @@
+#ifndef WSS_SPSC_READER_WRITER_H
+#define WSS_SPSC_READER_WRITER_H
+
+#include <atomic>
+#include <memory>
+#include "../io/ireaderwriter.h"
+#include "../portable_types.h"
+
+namespace wss {
+/*
+	SPSCQueue:  byte queue between exactly one producer thread and one consumer thread, no locks and no copies
+	beyond the producer's write into a block
+
+	Rules:
+		1.  bytes live in a singly linked list of blocks, the producer fills the tail block and links a new one when
+			it is full, the consumer reads from the head block and unlinks it once it is consumed
+		2.  the only state both threads touch is Written (bytes the producer has published), Consumed (bytes the
+			consumer has released), each block's Next and the Spare slot.  The producer's and the consumer's fields
+			are a full cache line apart so the two threads don't false share
+		3.  a block's Length is set before its Next is stored (release), the consumer only trusts Length once it
+			has loaded Next (acquire).  Bytes are only readable once Written covers them
+		4.  positions on the producer side are the total bytes ever written (it never shrinks), positions on the
+			consumer side are relative to the first unconsumed byte, the way every other IReaderWriter works
+		5.  an emptied block goes back to the producer through the one block Spare slot, anything more is freed
+		6.  maxQueued>0 bounds the bytes written but not consumed yet, the producer side is then fixedCapacity with
+			capacity() at produced()+room().  A fixed width write through ReaderWriter that doesn't fit in room()
+			returns 0 and publishes nothing, retry it once the consumer has caught up
+*/
+class SPSCQueue {
+public:
+	static const uint32_t DEFAULT_BLOCK_SIZE = 16384;
+	//queue and the producer / consumer streams over it, each stream keeps the queue alive.  Hand producer to the
+	//thread that writes (i.e. as a ComChannel's incoming stream) and consumer to the thread that reads
+	static void Create(IReaderWriter *&producer, IReaderWriter *&consumer, uint64_t maxQueued = 0, uint32_t blockSize = DEFAULT_BLOCK_SIZE);
+	SPSCQueue(uint64_t maxQueued, uint32_t blockSize);
+	~SPSCQueue();
+
+	//producer thread only
+	uint64_t produced() const {return Produced;}
+	//bytes that can be written before maxQueued is hit
+	uint64_t room() const;
+	size_t write(const void *src, size_t length);
+	void *prepare(size_t length, size_t &out_length);
+	size_t commit(size_t length);
+	bool bounded() const {return MaxQueued>0;}
+	uint32_t getBlockSize() const {return BlockSize;}
+
+	//consumer thread only, pos is relative to the first unconsumed byte
+	uint64_t available() const;
+	size_t read(uint64_t pos, void *dst, size_t length) const;
+	size_t readUntilDelim(uint64_t pos, void *dst, size_t length, char delim, bool &wasDelimHit) const;
+	const void *raw(uint64_t pos, size_t &out_length) const;
+	size_t consume(size_t length);
+private:
+	struct Block {
+		std::atomic<Block*> Next;
+		uint64_t Start;		//linear position of the first byte
+		uint32_t Length;	//bytes used, final once Next is set
+		uint8_t *data() {return reinterpret_cast<uint8_t*>(this+1);}
+	};
+	static const size_t CACHE_LINE = 64;
+	Block *newBlock(uint64_t start);
+	static void freeBlock(Block *b);
+	void recycle(Block *b);
+	//block holding linear position pos, pos must be < written
+	Block *find(uint64_t pos) const;
+	//readable bytes of b from pos on
+	static uint64_t contiguous(const Block *b, uint64_t pos, uint64_t written);
+private:
+	//set at construction
+	uint64_t MaxQueued;
+	uint32_t BlockSize;
+	char Pad0[CACHE_LINE];
+	//producer's line
+	std::atomic<uint64_t> Written;
+	Block *Tail;
+	uint32_t TailUsed;
+	uint64_t Produced;
+	char Pad1[CACHE_LINE];
+	//consumer's line
+	std::atomic<uint64_t> Consumed;
+	Block *Head;
+	uint64_t ConsumedLocal;
+	std::atomic<Block*> Spare;
+	char Pad2[CACHE_LINE];
+private:
+	SET_NO_COPY(SPSCQueue);
+};
+
+/*
+	producer end:  write, prepare and commit append to the queue (write only at size()), nothing can be read.
+	Sets EagerCommit so fixed width writes through ReaderWriter are published as they are made, whole (rule #6)
+*/
+class SPSCProducerReaderWriterImpl : public IReaderWriter
+{
+public:
+	SPSCProducerReaderWriterImpl(const std::shared_ptr<SPSCQueue> &queue);
+	virtual ~SPSCProducerReaderWriterImpl();
+	virtual size_t read(size_t pos, void * dst, size_t length);
+	virtual size_t readUntilDelim(size_t pos, void * dst, size_t length, char delim, bool &wasDelimHit);
+	virtual size_t write(size_t pos, const void * src, size_t length);
+	virtual size_t erase(size_t pos, size_t length);
+
+	virtual size_t size() const;
+	virtual size_t capacity() const;
+	virtual bool fixedCapacity() const;
+	virtual size_t getPreferredBlockSize() const;
+
+	virtual const void * raw(size_t idx, size_t& out_length) const;
+	virtual void * prepare(size_t length, size_t& out_length);
+	virtual size_t commit(size_t length);
+private:
+	std::shared_ptr<SPSCQueue> Queue;
+private:
+	SET_NO_COPY(SPSCProducerReaderWriterImpl);
+};
+
+/*
+	consumer end:  sees the bytes published so far, reads and consumes (erase only from the front), nothing can be
+	written.  size() grows as the producer publishes
+*/
+class SPSCConsumerReaderWriterImpl : public IReaderWriter
+{
+public:
+	SPSCConsumerReaderWriterImpl(const std::shared_ptr<SPSCQueue> &queue);
+	virtual ~SPSCConsumerReaderWriterImpl();
+	virtual size_t read(size_t pos, void * dst, size_t length);
+	virtual size_t readUntilDelim(size_t pos, void * dst, size_t length, char delim, bool &wasDelimHit);
+	virtual size_t write(size_t pos, const void * src, size_t length);
+	virtual size_t erase(size_t pos, size_t length);
+	virtual size_t consume(size_t length);
+
+	virtual size_t size() const;
+	virtual size_t capacity() const;
+	virtual bool fixedCapacity() const;
+	virtual size_t getPreferredBlockSize() const;
+
+	virtual const void * raw(size_t idx, size_t& out_length) const;
+private:
+	std::shared_ptr<SPSCQueue> Queue;
+private:
+	SET_NO_COPY(SPSCConsumerReaderWriterImpl);
+};
+
+}
+#endif
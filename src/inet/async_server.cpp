@@ -0,0 +1,1018 @@
+#include <sys/epoll.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include "async_server.h"
+#include "../buffer/pooled_block_allocator.h"
+#include "../wsinit.h"
+//last, linux/io_uring.h pulls in linux/fs.h which defines BLOCK_SIZE
+#include "uring.h"
+
+using namespace wss;
+
+//what every channel is watched for, EPOLLOUT is added while there is data the socket didn't take
+static const uint32_t CHANNEL_EVENTS = EPOLLIN | EPOLLRDHUP | EPOLLET;
+//a connect in flight is done when the socket turns writable (or errors)
+static const uint32_t CONNECT_EVENTS = EPOLLOUT | EPOLLET;
+//how long connections left in the backlog for lack of descriptors wait before accepting is tried again
+static const int ACCEPT_RETRY_MS = 100;
+
+//bounded incoming buffer with no room left, reading the socket has to wait for the application
+static bool isIncomingFull(const ComChannel &channel) {
+	const ReaderWriter &in = channel.getIncomingBuffer();
+	return in.fixedCapacity() && in.size()>=in.capacity();
+}
+
+static uint64_t nowMS() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return uint64_t(ts.tv_sec)*1000 + uint64_t(ts.tv_nsec)/1000000;
+}
+
+ASyncServer::ASyncServer() : mEPollFD(-1), mRing(0), mRecvBuffers(), mEvents(), mMaxEvents(0), mListener(std::shared_ptr<TCPSocketInterface>())
+	, mListenerState(), mChannels(), mConnecting(), mConnectDeadlines(), mTouched(), mReadBlocked(), mAcceptRetryAt(0), mAcceptFailing(false), mLastError() {
+	mListenerState.Channel = 0;
+	mListenerState.Connecting = 0;
+	mListenerState.Deadline = mConnectDeadlines.end();
+	mListenerState.Events = EPOLLIN | EPOLLET;
+	mListenerState.Touched = false;
+	mListenerState.ReadBlocked = false;
+	mListenerState.HungUp = false;
+	mListenerState.PeerDone = false;
+	mListenerState.Pending = 0;
+	mListenerState.RecvArmed = false;
+	mListenerState.SendArmed = false;
+	mListenerState.Closing = false;
+}
+
+ASyncServer::~ASyncServer() {
+	if(mRing) {
+		//the kernel may still be using the channels' sockets and buffers
+		closeURing();
+	}
+	for(auto it = mChannels.begin();it!=mChannels.end();++it) {
+		delete it->first;
+	}
+	mChannels.clear();
+	for(auto it = mConnecting.begin();it!=mConnecting.end();++it) {
+		delete it->first;
+	}
+	mConnecting.clear();
+	mConnectDeadlines.clear();
+	if(mListener.ok()) {
+		mListener.closeSocket();
+	}
+	if(mEPollFD>=0) {
+		::close(mEPollFD);
+	}
+}
+
+/**********************************************************************************************
+* ASyncServer::init -- pick the engine and set it up
+*
+* In: maxEvents - epoll events handled per pulse, io_uring ring size and receive buffer count
+*		engine - ENGINE_AUTO falls back to epoll if io_uring can't be set up
+*
+*********************************************************************************************/
+ErrorType ASyncServer::init(int maxEvents, Engine engine) {
+	if(!mRing && mEPollFD<0 && engine!=ENGINE_EPOLL) {
+		ErrorType et = initURing(maxEvents);
+		if(!et) {
+			if(engine==ENGINE_URING) {
+				return mLastError = et;
+			}
+			GET_LOGGER->info("ASyncServer io_uring unavailable ({}), using epoll", et.getOSErrorString().c_str());
+		}
+	}
+	if(mRing) {
+		return ErrorType();
+	}
+	if(mEPollFD<0) {
+		mEPollFD = epoll_create1(EPOLL_CLOEXEC);
+		if(mEPollFD<0) {
+			return setLastError();
+		}
+	}
+	mMaxEvents = (std::max)(maxEvents,1);
+	mEvents.resize(mMaxEvents);
+	return ErrorType();
+}
+
+ASyncServer::Engine ASyncServer::getEngine() const {
+	if(mRing) {
+		return ENGINE_URING;
+	}
+	return mEPollFD>=0 ? ENGINE_EPOLL : ENGINE_AUTO;
+}
+
+/**********************************************************************************************
+* ASyncServer::addListener -- accept connections from listener each time it is readable
+*
+*********************************************************************************************/
+ErrorType ASyncServer::addListener(const ListenerSocket &listener) {
+	if(mListener.ok()) {
+		return ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SEISCONN);
+	}
+	mListener = listener;
+	ErrorType et = mListener.setNonBlocking();
+	if(et) {
+		if(mRing) {
+			if(!armAccept()) {
+				et = ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SENOBUFS);
+			}
+		} else {
+			et = control(EPOLL_CTL_ADD,mListener.getNativeHandle(),mListenerState);
+		}
+	}
+	if(!et) {
+		mListener = ListenerSocket(std::shared_ptr<TCPSocketInterface>());
+	}
+	return et;
+}
+
+/**********************************************************************************************
+* ASyncServer::addChannel -- own channel and watch its socket
+*
+* Returns: error if the socket could not be added to the epoll set, the channel is deleted
+*
+*********************************************************************************************/
+ErrorType ASyncServer::addChannel(TCPComChannel *channel) {
+	ChannelState &cs = mChannels[channel];
+	cs.Channel = channel;
+	cs.Connecting = 0;
+	cs.Deadline = mConnectDeadlines.end();
+	cs.Events = CHANNEL_EVENTS;
+	cs.Touched = false;
+	cs.ReadBlocked = false;
+	cs.HungUp = false;
+	cs.PeerDone = false;
+	cs.Pending = 0;
+	cs.RecvArmed = false;
+	cs.SendArmed = false;
+	cs.Closing = false;
+	ErrorType et;
+	if(!mRing) {
+		et = control(EPOLL_CTL_ADD,channel->getNativeHandle(),cs);
+		if(!et) {
+			mChannels.erase(channel);
+			delete channel;
+			return et;
+		}
+	}
+	onChannelOpened(channel);
+	if(mRing) {
+		armRecv(cs);
+	}
+	flush(cs);
+	return et;
+}
+
+/**********************************************************************************************
+* ASyncServer::connect -- non blocking connect, watched by the event loop until it completes
+*
+* In: sock - owned by the server from here on
+*		timeoutMS - fail the connect with SETIMEDOUT if it isn't done by then, 0 for no timeout
+*
+* Returns: error if the connect could not be started, sock is deleted.  A connect that completes
+*	right away (i.e. loopback) is handed to onConnected before this returns
+*
+*********************************************************************************************/
+ErrorType ASyncServer::connect(TCPClientSocket *sock, const InetAddressV4 &addr, short port, uint32_t timeoutMS) {
+	ErrorType et;
+	if(!mRing && mEPollFD<0) {
+		et = ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SEBADF);
+	}
+	if(et && !sock->isNonBlocking()) {
+		et = sock->setNonBlocking();
+	}
+	if(et) {
+		et = sock->beginConnect(addr,port);
+	}
+	if(!et) {
+		delete sock;
+		return et;
+	}
+	if(sock->isConnected()) {
+		openConnected(sock);
+		return et;
+	}
+	ChannelState &cs = mConnecting[sock];
+	cs.Channel = 0;
+	cs.Connecting = sock;
+	cs.Deadline = timeoutMS ? mConnectDeadlines.insert(std::make_pair(nowMS()+timeoutMS,sock)) : mConnectDeadlines.end();
+	cs.Events = CONNECT_EVENTS;
+	cs.Touched = false;
+	cs.ReadBlocked = false;
+	cs.HungUp = false;
+	cs.PeerDone = false;
+	cs.Pending = 0;
+	cs.RecvArmed = false;
+	cs.SendArmed = false;
+	cs.Closing = false;
+	if(mRing) {
+		if(!armConnect(cs)) {
+			et = ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SENOBUFS);
+		}
+	} else {
+		et = control(EPOLL_CTL_ADD,sock->getNativeHandle(),cs);
+	}
+	if(!et) {
+		if(cs.Deadline!=mConnectDeadlines.end()) {
+			mConnectDeadlines.erase(cs.Deadline);
+		}
+		mConnecting.erase(sock);
+		delete sock;
+	}
+	return et;
+}
+
+/**********************************************************************************************
+* ASyncServer::completeConnect -- the socket of a connect turned writable, errored, or it timed out
+*
+* In: et - timeout or the error io_uring reported, no error to check the socket
+*
+*********************************************************************************************/
+void ASyncServer::completeConnect(ChannelState &cs, ErrorType et) {
+	TCPClientSocket *sock = cs.Connecting;
+	if(!mRing) {
+		control(EPOLL_CTL_DEL,sock->getNativeHandle(),cs);
+	}
+	if(cs.Deadline!=mConnectDeadlines.end()) {
+		mConnectDeadlines.erase(cs.Deadline);
+	}
+	mConnecting.erase(sock);
+	if(et) {
+		et = sock->finishConnect();
+	}
+	if(et) {
+		openConnected(sock);
+	} else {
+		sock->closeSocket();
+		onConnectFailed(sock,et);
+		delete sock;
+	}
+}
+
+void ASyncServer::openConnected(TCPClientSocket *sock) {
+	TCPComChannel *channel = onConnected(sock);
+	if(channel) {
+		addChannel(channel);
+	} else {
+		delete sock;
+	}
+}
+
+/**********************************************************************************************
+* ASyncServer::retryAccept -- accept what was left in the backlog when descriptors ran out
+*	(io_uring: re-arm the accept it ended)
+*
+* Returns: waitTimeMS shortened so the wait ends by the next retry
+*
+*********************************************************************************************/
+int ASyncServer::retryAccept(int waitTimeMS) {
+	if(!mAcceptRetryAt) {
+		return waitTimeMS;
+	}
+	uint64_t now = nowMS();
+	if(now>=mAcceptRetryAt) {
+		mAcceptRetryAt = 0;
+		if(!mRing) {
+			acceptConnections();
+		} else if(mListenerState.Pending==0 && !armAccept()) {
+			mAcceptRetryAt = now+ACCEPT_RETRY_MS;
+		}
+	}
+	if(mAcceptRetryAt) {
+		uint64_t left = mAcceptRetryAt>now ? mAcceptRetryAt-now : 0;
+		if(waitTimeMS<0 || left<uint64_t(waitTimeMS)) {
+			waitTimeMS = int(left);
+		}
+	}
+	return waitTimeMS;
+}
+
+/**********************************************************************************************
+* ASyncServer::expireConnects -- fail the connects past their timeout (io_uring: cancel their poll,
+*	they fail when it completes)
+*
+* Returns: waitTimeMS shortened so the wait ends by the next timeout, 0 if a connect failed
+*
+*********************************************************************************************/
+int ASyncServer::expireConnects(int waitTimeMS) {
+	if(mConnectDeadlines.empty()) {
+		return waitTimeMS;
+	}
+	uint64_t now = nowMS();
+	while(!mConnectDeadlines.empty() && mConnectDeadlines.begin()->first<=now) {
+		ChannelState &cs = mConnecting[mConnectDeadlines.begin()->second];
+		if(!mRing) {
+			//the application has something to react to, don't wait
+			completeConnect(cs,ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SETIMEDOUT));
+			waitTimeMS = 0;
+			continue;
+		}
+		cancel(cs);
+		if(!cs.Closing) {
+			//no room to submit the cancel, try again next pulse
+			break;
+		}
+		mConnectDeadlines.erase(cs.Deadline);
+		cs.Deadline = mConnectDeadlines.end();
+	}
+	if(!mConnectDeadlines.empty()) {
+		uint64_t left = mConnectDeadlines.begin()->first>now ? mConnectDeadlines.begin()->first-now : 0;
+		if(waitTimeMS<0 || left<uint64_t(waitTimeMS)) {
+			waitTimeMS = int(left);
+		}
+	}
+	return waitTimeMS;
+}
+
+/**********************************************************************************************
+* ASyncServer::pulse -- one turn of the event loop
+*
+* In: waitTimeMS - longest to wait for readiness, -1 waits until there is some
+*
+* Returns: number of epoll events handled, -1 on error
+*
+*********************************************************************************************/
+int ASyncServer::pulse(int waitTimeMS) {
+	if(mRing) {
+		return pulseURing(waitTimeMS);
+	}
+	if(mEPollFD<0) {
+		mLastError = ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SEBADF);
+		return -1;
+	}
+	//a blocked channel the application made room in has data left in the socket, there won't be another edge for it
+	if(retryBlockedReads()) {
+		waitTimeMS = 0;
+	}
+	waitTimeMS = expireConnects(waitTimeMS);
+	waitTimeMS = retryAccept(waitTimeMS);
+	int count = epoll_wait(mEPollFD,&mEvents[0],mMaxEvents,waitTimeMS);
+	if(count<0) {
+		if(errno!=EINTR) {
+			setLastError();
+			return -1;
+		}
+		count = 0;
+	}
+	for(int i=0;i<count;++i) {
+		ChannelState &cs = *static_cast<ChannelState*>(mEvents[i].data.ptr);
+		uint32_t events = mEvents[i].events;
+		if(&cs==&mListenerState) {
+			acceptConnections();
+			continue;
+		}
+		if(cs.Connecting) {
+			completeConnect(cs,ErrorType());
+			continue;
+		}
+		touch(cs);
+		if(events & (EPOLLERR|EPOLLHUP)) {
+			//nothing more can be sent, read what is left and close
+			cs.HungUp = true;
+			cs.Channel->setDeath();
+		}
+		if(events & (EPOLLIN|EPOLLRDHUP|EPOLLERR|EPOLLHUP)) {
+			handleRead(cs);
+		}
+		if(events & EPOLLRDHUP) {
+			//peer is done sending, close once what we have for it is sent.  A blocked channel still has
+			//data in the socket, it is marked once a read leaves it unblocked (handleRead)
+			if(cs.ReadBlocked) {
+				cs.PeerDone = true;
+			} else {
+				cs.Channel->setDeath();
+			}
+		}
+		if((events & EPOLLOUT) && !cs.HungUp) {
+			flush(cs);
+		}
+	}
+	reap();
+	return count;
+}
+
+void ASyncServer::flush(TCPComChannel *channel) {
+	auto it = mChannels.find(channel);
+	if(it!=mChannels.end()) {
+		flush(it->second);
+		if(mRing) {
+			submitQueued();
+		}
+	}
+}
+
+TCPComChannel *ASyncServer::onNewConnection(TCPServerSocket *sock) {
+	return new TCPComChannel(sock);
+}
+
+/**********************************************************************************************
+* ASyncServer::acceptConnections -- edge triggered so accept until the backlog is empty, a batch
+*	at a time.  Running out of descriptors leaves the rest of the backlog with no edge to come
+*	back for it, so it is tried again ACCEPT_RETRY_MS later
+*
+*********************************************************************************************/
+void ASyncServer::acceptConnections() {
+	std::vector<TCPServerSocket*> socks;
+	mAcceptRetryAt = 0;
+	for(;;) {
+		socks.clear();
+		ErrorType et = mListener.getNewConnections(socks,ACCEPT_BATCH);
+		if(!socks.empty()) {
+			mAcceptFailing = false;
+		}
+		for(size_t i=0;i<socks.size();++i) {
+			TCPComChannel *channel = onNewConnection(socks[i]);
+			if(channel) {
+				addChannel(channel);
+			} else {
+				delete socks[i];
+			}
+		}
+		if(!et) {
+			if(!mAcceptFailing) {
+				GET_LOGGER->error("ASyncServer accept error: {}", et.getOSErrorString().c_str());
+				mAcceptFailing = true;
+			}
+			//still listening means descriptors or memory ran out, anything else closed the listener
+			if(mListener.getNativeHandle()!=BaseSocketInterface::BAD_SOCKET) {
+				mAcceptRetryAt = nowMS()+ACCEPT_RETRY_MS;
+			}
+			break;
+		}
+		if(socks.size()<ACCEPT_BATCH) {
+			break;
+		}
+	}
+}
+
+/**********************************************************************************************
+* ASyncServer::handleRead -- drain the socket into the incoming buffer and hand it to the application
+*
+*********************************************************************************************/
+void ASyncServer::handleRead(ChannelState &cs) {
+	TCPComChannel *channel = cs.Channel;
+	int bytes = channel->bufferIn();
+	if(channel->getNativeHandle()==BaseSocketInterface::BAD_SOCKET) {
+		//the read hit an error (or the end on a stream read with receive) and closed the socket, nothing more can be sent
+		cs.HungUp = true;
+		channel->setDeath();
+	}
+	//check before the application removes anything, a buffer that filled up may have left data in the socket
+	if(!cs.ReadBlocked && isIncomingFull(*channel)) {
+		cs.ReadBlocked = true;
+		mReadBlocked.push_back(&cs);
+	}
+	if(cs.PeerDone && !cs.ReadBlocked) {
+		//the socket held nothing more than what fit, the edge for the hang up came while blocked
+		channel->setDeath();
+	}
+	if(bytes>0) {
+		onChannelData(channel);
+		if(!cs.HungUp) {
+			flush(cs);
+		}
+	} else if(bytes==0) {
+		//orderly shutdown or error
+		channel->setDeath();
+	}
+}
+
+/**********************************************************************************************
+* ASyncServer::retryBlockedReads -- read channels whose full incoming buffer has room again
+*	(io_uring: arm what could not be armed before)
+*
+* Returns: true if a channel blocked again has room, i.e. the application consumed in onChannelData
+*
+*********************************************************************************************/
+bool ASyncServer::retryBlockedReads() {
+	if(mReadBlocked.empty()) {
+		return false;
+	}
+	std::vector<ChannelState*> blocked;
+	blocked.swap(mReadBlocked);
+	for(size_t i=0;i<blocked.size();++i) {
+		ChannelState &cs = *blocked[i];
+		cs.ReadBlocked = false;
+		if(isIncomingFull(*cs.Channel)) {
+			cs.ReadBlocked = true;
+			mReadBlocked.push_back(&cs);
+		} else {
+			touch(cs);
+			if(mRing) {
+				armRecv(cs);
+				armSend(cs);
+			} else {
+				handleRead(cs);
+			}
+		}
+	}
+	for(size_t i=0;i<mReadBlocked.size();++i) {
+		if(!isIncomingFull(*mReadBlocked[i]->Channel)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**********************************************************************************************
+* ASyncServer::flush -- send, then watch for EPOLLOUT only if the socket did not take it all
+*
+*********************************************************************************************/
+void ASyncServer::flush(ChannelState &cs) {
+	TCPComChannel *channel = cs.Channel;
+	touch(cs);
+	if(mRing) {
+		armSend(cs);
+		return;
+	}
+	if(cs.HungUp || channel->getNativeHandle()==BaseSocketInterface::BAD_SOCKET) {
+		return;
+	}
+	if(channel->hasDataToSend()) {
+		channel->sendData();
+	}
+	uint32_t events = CHANNEL_EVENTS | (channel->hasDataToSend() ? uint32_t(EPOLLOUT) : 0);
+	if(events!=cs.Events) {
+		cs.Events = events;
+		control(EPOLL_CTL_MOD,channel->getNativeHandle(),cs);
+	}
+}
+
+void ASyncServer::touch(ChannelState &cs) {
+	if(!cs.Touched) {
+		cs.Touched = true;
+		mTouched.push_back(&cs);
+	}
+}
+
+/**********************************************************************************************
+* ASyncServer::reap -- close channels touched this pulse that are marked for death and have
+*	nothing left to send (or can't send it)
+*
+*********************************************************************************************/
+void ASyncServer::reap() {
+	std::vector<TCPComChannel*> dead;
+	for(size_t i=0;i<mTouched.size();++i) {
+		ChannelState &cs = *mTouched[i];
+		cs.Touched = false;
+		if(cs.ReadBlocked && !cs.HungUp) {
+			//unread data is waiting for room in the incoming buffer (rule #5), close after it is read
+			continue;
+		}
+		if(cs.Channel->markedForDeath() && (cs.HungUp || !cs.Channel->hasDataToSend())) {
+			if(cs.Pending) {
+				//io_uring still has the socket, the channel goes once what is in flight is cancelled
+				cancel(cs);
+			} else {
+				dead.push_back(cs.Channel);
+			}
+		}
+	}
+	mTouched.clear();
+	for(size_t i=0;i<dead.size();++i) {
+		closeChannel(dead[i]);
+	}
+}
+
+void ASyncServer::closeChannel(TCPComChannel *channel) {
+	auto it = mChannels.find(channel);
+	if(it==mChannels.end()) {
+		return;
+	}
+	ChannelState &cs = it->second;
+	if(cs.ReadBlocked) {
+		mReadBlocked.erase(std::find(mReadBlocked.begin(),mReadBlocked.end(),&cs));
+	}
+	onChannelClosed(channel);
+	if(!mRing && channel->getNativeHandle()!=BaseSocketInterface::BAD_SOCKET) {
+		control(EPOLL_CTL_DEL,channel->getNativeHandle(),cs);
+	}
+	mChannels.erase(it);
+	delete channel;
+}
+
+ErrorType ASyncServer::control(int op, int fd, ChannelState &cs) {
+	struct epoll_event ev;
+	ev.events = cs.Events;
+	ev.data.ptr = &cs;
+	if(epoll_ctl(mEPollFD,op,fd,&ev)!=0) {
+		return setLastError();
+	}
+	return ErrorType();
+}
+
+ErrorType ASyncServer::setLastError() {
+	mLastError = ErrorType(ErrorType::codeOSSpecific,errno);
+	return mLastError;
+}
+
+void ASyncServer::rearmLater(ChannelState &cs) {
+	if(!cs.ReadBlocked) {
+		cs.ReadBlocked = true;
+		mReadBlocked.push_back(&cs);
+	}
+}
+
+#ifdef WSS_HAS_URING
+
+//what a completion is for, kept in the low bits of user_data under the ChannelState pointer
+enum {OP_ACCEPT = 1, OP_RECV = 2, OP_SEND = 3, OP_CANCEL = 4, OP_CONNECT = 5, OP_MASK = 7};
+enum {RECV_BUFFER_GROUP = 0, MAX_URING_ENTRIES = 32768, DRAIN_WAIT_MS = 100, DRAIN_TRIES = 50};
+
+typedef PooledBlockBufferAllocator<ASyncServer::RECV_BUFFER_SIZE> RecvBufferAllocator;
+
+//a send points the kernel straight at the outgoing buffer's spans
+static_assert(sizeof(ConstBufferSpan)==sizeof(struct iovec) && offsetof(ConstBufferSpan,Length)==offsetof(struct iovec,iov_len),
+	"ConstBufferSpan must be laid out like struct iovec");
+
+static uint64_t userData(void *state, uint64_t op) {
+	return reinterpret_cast<uint64_t>(state) | op;
+}
+
+/**********************************************************************************************
+* ASyncServer::initURing -- ring plus a provided buffer ring of receive blocks
+*
+*********************************************************************************************/
+ErrorType ASyncServer::initURing(int maxEvents) {
+	static_assert(alignof(ChannelState)>OP_MASK, "user_data op tag needs the low bits of a ChannelState pointer");
+	uint32_t entries = 1;
+	while(entries<uint32_t((std::max)(maxEvents,1)) && entries<MAX_URING_ENTRIES) {
+		entries <<= 1;
+	}
+	URing *ring = new URing();
+	ErrorType et = ring->init(entries);
+	if(et) {
+		et = ring->initBufferRing(RECV_BUFFER_GROUP,entries);
+	}
+	if(!et) {
+		delete ring;
+		return et;
+	}
+	mRing = ring;
+	mRecvBuffers.resize(entries);
+	for(uint32_t i=0;i<entries;++i) {
+		mRecvBuffers[i] = allocateRecvBuffer();
+		mRing->provideBuffer(mRecvBuffers[i]->getAllocatedStart(),RECV_BUFFER_SIZE,uint16_t(i));
+	}
+	mRing->publishBuffers();
+	return et;
+}
+
+/**********************************************************************************************
+* ASyncServer::closeURing -- cancel everything in flight and wait for it to complete before the
+*	sockets and buffers it points at go away
+*
+*********************************************************************************************/
+void ASyncServer::closeURing() {
+	io_uring_sqe *sqe = getSQE();
+	if(sqe) {
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+		sqe->user_data = OP_CANCEL;
+	}
+	for(int tries=0;tries<DRAIN_TRIES;++tries) {
+		uint32_t pending = mListenerState.Pending;
+		for(auto it = mChannels.begin();it!=mChannels.end();++it) {
+			pending += it->second.Pending;
+		}
+		for(auto it = mConnecting.begin();it!=mConnecting.end();++it) {
+			pending += it->second.Pending;
+		}
+		if(pending==0 || mRing->submitAndWait(DRAIN_WAIT_MS)<0) {
+			break;
+		}
+		for(io_uring_cqe *cqe = mRing->peekCQE();cqe;cqe = mRing->peekCQE()) {
+			uint64_t data = cqe->user_data;
+			int res = cqe->res;
+			uint32_t flags = cqe->flags;
+			mRing->seenCQE();
+			ChannelState *cs = reinterpret_cast<ChannelState*>(data & ~uint64_t(OP_MASK));
+			switch(data & OP_MASK) {
+			case OP_ACCEPT:
+				if(res>=0) {
+					::close(res);
+				}
+				if(!(flags & IORING_CQE_F_MORE)) {
+					--mListenerState.Pending;
+				}
+				break;
+			case OP_RECV:
+			case OP_SEND:
+			case OP_CONNECT:
+				--cs->Pending;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	delete mRing;
+	mRing = 0;
+	std::for_each(mRecvBuffers.begin(),mRecvBuffers.end(),&BlockBuffer::release);
+	mRecvBuffers.clear();
+}
+
+/**********************************************************************************************
+* ASyncServer::pulseURing -- submit what was queued, wait for completions and dispatch them
+*
+* Returns: number of completions handled, -1 on error
+*
+*********************************************************************************************/
+int ASyncServer::pulseURing(int waitTimeMS) {
+	if(retryBlockedReads()) {
+		waitTimeMS = 0;
+	}
+	waitTimeMS = expireConnects(waitTimeMS);
+	waitTimeMS = retryAccept(waitTimeMS);
+	int ret = mRing->submitAndWait(waitTimeMS);
+	if(ret<0) {
+		mLastError = ErrorType(ErrorType::codeOSSpecific,-ret);
+		return -1;
+	}
+	int count = 0;
+	for(io_uring_cqe *cqe = mRing->peekCQE();cqe;cqe = mRing->peekCQE()) {
+		uint64_t data = cqe->user_data;
+		int res = cqe->res;
+		uint32_t flags = cqe->flags;
+		mRing->seenCQE();
+		++count;
+		ChannelState *cs = reinterpret_cast<ChannelState*>(data & ~uint64_t(OP_MASK));
+		switch(data & OP_MASK) {
+		case OP_ACCEPT:
+			onAccepted(res,flags);
+			break;
+		case OP_RECV:
+			onReceived(*cs,res,flags);
+			break;
+		case OP_SEND:
+			onSent(*cs,res);
+			break;
+		case OP_CONNECT:
+			--cs->Pending;
+			if(res<0) {
+				//cancelled because it timed out
+				completeConnect(*cs,ErrorType(ErrorType::codeOSSpecific,cs->Closing ? int(BaseSocketInterface::SETIMEDOUT) : -res));
+			} else {
+				completeConnect(*cs,ErrorType());
+			}
+			break;
+		default:
+			//a cancel finished, what it cancelled completes on its own
+			break;
+		}
+	}
+	//receive buffers given back or replaced while dispatching
+	mRing->publishBuffers();
+	reap();
+	return count;
+}
+
+void ASyncServer::submitQueued() {
+	mRing->submit();
+}
+
+io_uring_sqe *ASyncServer::getSQE() {
+	io_uring_sqe *sqe = mRing->getSQE();
+	if(!sqe) {
+		//submission ring is full, hand it to the kernel to make room
+		mRing->submit();
+		sqe = mRing->getSQE();
+	}
+	return sqe;
+}
+
+/**********************************************************************************************
+* ASyncServer::armAccept -- one multishot accept keeps completing for every new connection
+*
+*********************************************************************************************/
+bool ASyncServer::armAccept() {
+	io_uring_sqe *sqe = getSQE();
+	if(!sqe) {
+		return false;
+	}
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = mListener.getNativeHandle();
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe->user_data = userData(&mListenerState,OP_ACCEPT);
+	++mListenerState.Pending;
+	return true;
+}
+
+/**********************************************************************************************
+* ASyncServer::armConnect -- poll the connecting socket for writable, it completes once
+*
+*********************************************************************************************/
+bool ASyncServer::armConnect(ChannelState &cs) {
+	io_uring_sqe *sqe = getSQE();
+	if(!sqe) {
+		return false;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = cs.Connecting->getNativeHandle();
+	sqe->poll32_events = POLLOUT;
+	sqe->user_data = userData(&cs,OP_CONNECT);
+	++cs.Pending;
+	return true;
+}
+
+/**********************************************************************************************
+* ASyncServer::armRecv -- receive into whichever provided buffer the kernel picks, no more than a
+*	bounded incoming buffer has room for
+*
+*********************************************************************************************/
+void ASyncServer::armRecv(ChannelState &cs) {
+	if(cs.RecvArmed || cs.HungUp || cs.Closing) {
+		return;
+	}
+	const ReaderWriter &in = static_cast<const ComChannel*>(cs.Channel)->getIncomingBuffer();
+	size_t room = RECV_BUFFER_SIZE;
+	if(in.fixedCapacity()) {
+		room = (std::min)(room,in.capacity()-in.size());
+	}
+	io_uring_sqe *sqe = room ? getSQE() : 0;
+	if(!sqe) {
+		rearmLater(cs);
+		return;
+	}
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = cs.Channel->getNativeHandle();
+	sqe->len = uint32_t(room);
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = RECV_BUFFER_GROUP;
+	sqe->user_data = userData(&cs,OP_RECV);
+	cs.RecvArmed = true;
+	++cs.Pending;
+}
+
+/**********************************************************************************************
+* ASyncServer::armSend -- one gather send of the front of the outgoing buffer, the channel keeps
+*	those bytes in place until it completes
+*
+*********************************************************************************************/
+void ASyncServer::armSend(ChannelState &cs) {
+	TCPComChannel *channel = cs.Channel;
+	if(cs.SendArmed || cs.HungUp || cs.Closing || !channel->hasDataToSend()) {
+		return;
+	}
+	io_uring_sqe *sqe = getSQE();
+	if(!sqe) {
+		rearmLater(cs);
+		return;
+	}
+	cs.SendSpans.resize(BaseSocketInterface::MAX_IOVEC);
+	size_t count = channel->getOutSpans(&cs.SendSpans[0],cs.SendSpans.size());
+	memset(&cs.SendMsg,0,sizeof(cs.SendMsg));
+	cs.SendMsg.msg_iov = reinterpret_cast<struct iovec*>(&cs.SendSpans[0]);
+	cs.SendMsg.msg_iovlen = count;
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = channel->getNativeHandle();
+	sqe->addr = reinterpret_cast<uint64_t>(&cs.SendMsg);
+	sqe->len = 1;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = userData(&cs,OP_SEND);
+	cs.SendArmed = true;
+	++cs.Pending;
+}
+
+void ASyncServer::cancel(ChannelState &cs) {
+	if(cs.Closing) {
+		return;
+	}
+	io_uring_sqe *sqe = getSQE();
+	if(!sqe) {
+		//a connect is cancelled again by the next expireConnects
+		if(cs.Channel) {
+			rearmLater(cs);
+		}
+		return;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = cs.Channel ? cs.Channel->getNativeHandle() : cs.Connecting->getNativeHandle();
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	sqe->user_data = OP_CANCEL;
+	cs.Closing = true;
+}
+
+/**********************************************************************************************
+* ASyncServer::onAccepted -- a multishot accept completion, re-armed if the kernel ended it
+*
+*********************************************************************************************/
+void ASyncServer::onAccepted(int res, uint32_t flags) {
+	if(!(flags & IORING_CQE_F_MORE)) {
+		--mListenerState.Pending;
+		if(res==-EMFILE || res==-ENFILE || res==-ENOBUFS || res==-ENOMEM) {
+			//re-arming now would fail straight away, give descriptors a pulse to free up
+			mAcceptRetryAt = nowMS()+ACCEPT_RETRY_MS;
+		} else if(res!=-ECANCELED && mListener.ok() && !armAccept()) {
+			GET_LOGGER->error("ASyncServer could not re-arm accept");
+		}
+	}
+	if(res<0) {
+		if(res!=-ECANCELED && res!=-EAGAIN && res!=-ECONNABORTED && !mAcceptFailing) {
+			GET_LOGGER->error("ASyncServer accept error: {}", ErrorType(ErrorType::codeOSSpecific,-res).getOSErrorString().c_str());
+			mAcceptFailing = mAcceptRetryAt!=0;
+		}
+		return;
+	}
+	mAcceptFailing = false;
+	TCPServerSocket *sock = mListener.adoptConnection<TCPServerSocket>(res);
+	TCPComChannel *channel = onNewConnection(sock);
+	if(channel) {
+		addChannel(channel);
+	} else {
+		delete sock;
+	}
+}
+
+/**********************************************************************************************
+* ASyncServer::onReceived -- a receive completed into provided buffer (flags >> BUFFER_SHIFT)
+*
+*	Small reads (or a bounded incoming buffer, which copies anyway) are copied out and the block is
+*	provided again.  Bigger ones hand the block itself to the incoming buffer and a new block is
+*	provided in its place, so bulk data is never copied.
+*
+*********************************************************************************************/
+void ASyncServer::onReceived(ChannelState &cs, int res, uint32_t flags) {
+	TCPComChannel *channel = cs.Channel;
+	cs.RecvArmed = false;
+	--cs.Pending;
+	touch(cs);
+	if(flags & IORING_CQE_F_BUFFER) {
+		uint16_t id = uint16_t(flags >> IORING_CQE_BUFFER_SHIFT);
+		BlockBuffer *block = mRecvBuffers[id];
+		if(res>0) {
+			const uint8_t *data = block->getAllocatedStart();
+			if(res<RECV_BUFFER_SIZE/4 || static_cast<const ComChannel*>(channel)->getIncomingBuffer().fixedCapacity()) {
+				channel->bufferIn(data,size_t(res));
+			} else {
+				SharedBuffer received;
+				received.append(block,data,uint32_t(res));
+				BlockBuffer::release(block);
+				channel->bufferIn(received);
+				block = mRecvBuffers[id] = allocateRecvBuffer();
+			}
+		}
+		mRing->provideBuffer(block->getAllocatedStart(),RECV_BUFFER_SIZE,id);
+	}
+	if(res>0) {
+		onChannelData(channel);
+		if(!cs.HungUp) {
+			flush(cs);
+		}
+		armRecv(cs);
+	} else if(res==0) {
+		//orderly shutdown
+		channel->setDeath();
+	} else if(res==-ENOBUFS) {
+		//every provided buffer was in use, they are given back by the end of the pulse
+		rearmLater(cs);
+	} else if(res!=-ECANCELED) {
+		GET_LOGGER->error("ASyncServer receive error: {}", ErrorType(ErrorType::codeOSSpecific,-res).getOSErrorString().c_str());
+		cs.HungUp = true;
+		channel->setDeath();
+	}
+}
+
+void ASyncServer::onSent(ChannelState &cs, int res) {
+	TCPComChannel *channel = cs.Channel;
+	cs.SendArmed = false;
+	--cs.Pending;
+	touch(cs);
+	channel->sentOut(res>0 ? size_t(res) : 0);
+	if(res<0 && res!=-ECANCELED) {
+		GET_LOGGER->error("ASyncServer send error: {}", ErrorType(ErrorType::codeOSSpecific,-res).getOSErrorString().c_str());
+		cs.HungUp = true;
+		channel->setDeath();
+	}
+	armSend(cs);
+}
+
+BlockBuffer *ASyncServer::allocateRecvBuffer() {
+	BlockBuffer *bb = RecvBufferAllocator::allocate();
+	bb->setReleaseFunction(&RecvBufferAllocator::deallocate);
+	return bb;
+}
+
+#else
+
+//built without io_uring headers, ENGINE_AUTO always ends up on epoll
+ErrorType ASyncServer::initURing(int) {return ErrorType(ErrorType::codeOSSpecific,EOPNOTSUPP);}
+void ASyncServer::closeURing() {}
+int ASyncServer::pulseURing(int) {return -1;}
+void ASyncServer::submitQueued() {}
+bool ASyncServer::armAccept() {return false;}
+bool ASyncServer::armConnect(ChannelState &) {return false;}
+void ASyncServer::armRecv(ChannelState &) {}
+void ASyncServer::armSend(ChannelState &) {}
+void ASyncServer::cancel(ChannelState &) {}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef WSS_ASYNC_SERVER_H
+#define WSS_ASYNC_SERVER_H
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <sys/uio.h>
+#include "../portable_types.h"
+#include "../error_type.h"
+#include "tcp.h"
+#include "channel.h"
+
+struct epoll_event;
+struct io_uring_sqe;
+
+namespace wss {
+	class URing;
+	class BlockBuffer;
+
+/*
+*	Edge triggered (epoll) event loop that owns a listener and the TCPComChannels accepted from it
+*
+*	Rules:
+*		1.	each pulse waits for readiness and only touches the channels the OS reported, an idle channel costs
+*			nothing per pulse
+*		2.	read readiness drains the socket into the channel's incoming buffer (bufferIn) then calls onChannelData
+*		3.	EPOLLOUT is only armed while a channel hasDataToSend after a send, and disarmed once it is drained
+*		4.	a channel that is markedForDeath is closed and deleted once its outgoing buffer is empty, a channel
+*			whose peer hung up is marked for death.  Channels are only deleted at the end of a pulse, so a channel
+*			handed to a callback stays valid for the rest of that pulse
+*		5.	a channel with a bounded (fixedCapacity) incoming buffer that fills up stops reading, it is read again
+*			each pulse once the application has removed data from the buffer.  It is not closed while blocked
+*			(unless the socket failed), so a peer that half-closes still has everything it sent read
+*		6.	data buffered or setDeath called outside a callback is only acted on after flush(channel)
+*		7.	an outbound connect (connect) is watched like any other socket until it completes, then it becomes
+*			a channel through onConnected.  Any number can be in flight, a pulse only touches those that finished
+*			or timed out
+*
+*	The io_uring engine (ENGINE_URING, or ENGINE_AUTO on a kernel that has it) keeps the same rules and hooks but
+*	completes I/O instead of reporting readiness:  a multishot accept stays armed on the listener, each channel
+*	has one receive armed into a kernel picked buffer (handed to the channel without a copy for large reads)
+*	and at most one gather send of its outgoing buffer in flight.  Everything queued in a pulse is submitted with
+*	the wait in one system call.  Don't call sendData on its channels, the server does the sending.
+*
+*	Subclass and override the on* hooks to handle traffic.  Not thread safe, one thread pulses a server.
+*	Linux only
+*/
+class ASyncServer {
+public:
+	enum {DEFAULT_MAX_EVENTS = 256, RECV_BUFFER_SIZE = 16384, ACCEPT_BATCH = 64};
+	enum Engine {
+		ENGINE_AUTO,		//io_uring if the kernel supports it, epoll otherwise
+		ENGINE_EPOLL,
+		ENGINE_URING		//io_uring or fail
+	};
+public:
+	ASyncServer();
+	/*
+	*	closes and deletes every channel and closes the listener
+	*/
+	virtual ~ASyncServer();
+	/*
+	*	creates the epoll set, maxEvents is the most readiness events handled per pulse.  For io_uring it sizes
+	*	the submission ring and the number of RECV_BUFFER_SIZE receive buffers.  The first init picks the engine
+	*/
+	ErrorType init(int maxEvents = DEFAULT_MAX_EVENTS, Engine engine = ENGINE_EPOLL);
+	/*
+	*	engine init picked, ENGINE_AUTO before init
+	*/
+	Engine getEngine() const;
+	/*
+	*	Start accepting from listener (listen must already have been called), the listener is made non
+	*	blocking and closed with the server.  Set the accepted sockets' options on it first with
+	*	ListenerSocket::setAcceptOptions
+	*/
+	ErrorType addListener(const ListenerSocket &listener);
+	/*
+	*	hand an already connected channel (i.e. an outbound connection) to the server, the server takes
+	*	ownership even on failure
+	*/
+	ErrorType addChannel(TCPComChannel *channel);
+	/*
+	*	start connecting sock to addr:port without waiting (sock is made non blocking), the server owns sock from
+	*	here on, even on failure.  Once connected onConnected turns it into a channel, if it fails or hasn't
+	*	connected in timeoutMS (0 leaves it to the OS) onConnectFailed is called and sock is deleted
+	*/
+	ErrorType connect(TCPClientSocket *sock, const InetAddressV4 &addr, short port, uint32_t timeoutMS = 0);
+	/*
+	*	one turn of the loop, wait up to waitTimeMS (-1 forever) for readiness, dispatch it and reap dead
+	*	channels.  Returns the number of OS events (or completions) handled or -1 on error (see getLastError)
+	*/
+	int pulse(int waitTimeMS);
+	/*
+	*	send what channel has buffered now, arming EPOLLOUT for whatever the socket doesn't take (io_uring
+	*	submits a send), and reap the channel at the end of the next pulse if it is marked for death
+	*/
+	void flush(TCPComChannel *channel);
+	/*
+	*	number of channels the server owns
+	*/
+	size_t getChannelCount() const {return mChannels.size();}
+	/*
+	*	number of connects still in flight
+	*/
+	size_t getConnectingCount() const {return mConnecting.size();}
+	/*
+	*	error from the last failed epoll or io_uring call
+	*/
+	ErrorType getLastError() const {return mLastError;}
+protected:
+	/*
+	*	new connection accepted, return the channel to own it (i.e. with bounded buffers) or 0 to refuse it,
+	*	a refused sock is deleted (closed) by the server
+	*/
+	virtual TCPComChannel *onNewConnection(TCPServerSocket *sock);
+	/*
+	*	channel was added, either accepted or through addChannel
+	*/
+	virtual void onChannelOpened(TCPComChannel * /*channel*/) {}
+	/*
+	*	new bytes are in channel's incoming buffer, remove what is processed with removeFromBuffer.
+	*	Anything written with bufferOut is sent when this returns
+	*/
+	virtual void onChannelData(TCPComChannel * /*channel*/) {}
+	/*
+	*	channel is about to be deleted
+	*/
+	virtual void onChannelClosed(TCPComChannel * /*channel*/) {}
+	/*
+	*	connect from connect completed, return the channel to own it or 0 to drop it (sock is deleted).
+	*	By default the same as an accepted connection
+	*/
+	virtual TCPComChannel *onConnected(TCPClientSocket *sock) {return onNewConnection(sock);}
+	/*
+	*	connect from connect failed or timed out (SETIMEDOUT), sock is already closed
+	*	and is deleted when this returns
+	*/
+	virtual void onConnectFailed(TCPClientSocket * /*sock*/, const ErrorType & /*error*/) {}
+private:
+	typedef std::multimap<uint64_t,TCPClientSocket*> ConnectDeadlines;	//monotonic ms -> connect
+	struct ChannelState {
+		TCPComChannel	*Channel;		//0 for the listener or a connect
+		TCPClientSocket	*Connecting;	//connect in flight
+		ConnectDeadlines::iterator	Deadline;	//mConnectDeadlines.end() without a timeout
+		uint32_t		Events;			//what epoll is watching for
+		bool			Touched;		//on mTouched this pulse
+		bool			ReadBlocked;	//on mReadBlocked, the incoming buffer was full (io_uring: or an operation has to be armed later)
+		bool			HungUp;			//socket error or hang up, nothing more can be sent
+		bool			PeerDone;		//epoll:  peer shut down its side while the channel was read blocked
+		//io_uring only
+		uint32_t		Pending;		//operations in flight, the channel can't be deleted until they complete
+		bool			RecvArmed;
+		bool			SendArmed;
+		bool			Closing;		//cancel submitted for what is in flight
+		std::vector<ConstBufferSpan>	SendSpans;	//what the send in flight points at, laid out as iovecs
+		struct msghdr	SendMsg;
+	};
+	void acceptConnections();
+	void openConnected(TCPClientSocket *sock);
+	void completeConnect(ChannelState &cs, ErrorType et);
+	int expireConnects(int waitTimeMS);
+	int retryAccept(int waitTimeMS);
+	void handleRead(ChannelState &cs);
+	bool retryBlockedReads();
+	void flush(ChannelState &cs);
+	void touch(ChannelState &cs);
+	void reap();
+	void closeChannel(TCPComChannel *channel);
+	ErrorType control(int op, int fd, ChannelState &cs);
+	ErrorType setLastError();
+	//io_uring engine
+	ErrorType initURing(int maxEvents);
+	void closeURing();
+	int pulseURing(int waitTimeMS);
+	void submitQueued();
+	io_uring_sqe *getSQE();
+	bool armAccept();
+	bool armConnect(ChannelState &cs);
+	void armRecv(ChannelState &cs);
+	void armSend(ChannelState &cs);
+	void cancel(ChannelState &cs);
+	void rearmLater(ChannelState &cs);
+	void onAccepted(int res, uint32_t flags);
+	void onReceived(ChannelState &cs, int res, uint32_t flags);
+	void onSent(ChannelState &cs, int res);
+	BlockBuffer *allocateRecvBuffer();
+private:
+	int											mEPollFD;
+	URing										*mRing;
+	std::vector<BlockBuffer*>					mRecvBuffers;	//provided buffer id -> block
+	std::vector<epoll_event>					mEvents;
+	int											mMaxEvents;
+	ListenerSocket								mListener;
+	ChannelState								mListenerState;
+	std::unordered_map<TCPComChannel*,ChannelState>	mChannels;
+	std::unordered_map<TCPClientSocket*,ChannelState>	mConnecting;
+	ConnectDeadlines							mConnectDeadlines;
+	std::vector<ChannelState*>					mTouched;		//channels to check for death at the end of the pulse
+	std::vector<ChannelState*>					mReadBlocked;
+	uint64_t									mAcceptRetryAt;	//accepting ran out of descriptors, when (monotonic ms) to try the backlog again, 0 for no retry
+	bool										mAcceptFailing;	//logged that, quiet until an accept works again
+	ErrorType									mLastError;
+private:
+	SET_NO_COPY(ASyncServer);
+};
+
+}
+#endif
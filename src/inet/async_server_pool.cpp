@@ -0,0 +1,147 @@
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include "async_server_pool.h"
+#include "../wsinit.h"
+
+using namespace wss;
+
+ASyncServerPool::ASyncServerPool(const ServerFactory &factory) : mFactory(factory), mServers(), mThreads(), mStop(false), mPort(), mOptions() {
+}
+
+ASyncServerPool::~ASyncServerPool() {
+	stop();
+}
+
+/**********************************************************************************************
+* ASyncServerPool::start -- a listener and server per reactor, then a thread per reactor
+*
+* In: addr, port - where to listen, port 0 picks a free port (getPort)
+*		reactorCount - number of reactor threads, 0 for one per usable cpu
+*		pinThreads - pin reactor i to usable cpu i
+*		backlog - listen backlog of each listener
+*		engine - epoll or io_uring for every reactor
+*
+* Returns: error from creating a listener or server, nothing is left running
+*
+*********************************************************************************************/
+ErrorType ASyncServerPool::start(const InetAddressV4 &addr, const PortNum &port, uint32_t reactorCount, bool pinThreads, int backlog, ASyncServer::Engine engine) {
+	if(!mThreads.empty()) {
+		return ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SEISCONN);
+	}
+	std::vector<int> cpus = getUsableCPUs();
+	if(reactorCount==0) {
+		reactorCount = (std::max)(cpus.empty() ? std::thread::hardware_concurrency() : uint32_t(cpus.size()),1u);
+	}
+	ErrorType et;
+	mPort = port;
+	for(uint32_t i=0;i<reactorCount && et;++i) {
+		ListenerSocket listener = ListenerSocket::create();
+		if(!listener.ok()) {
+			et = ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SEMFILE);
+			break;
+		}
+		et = listener.setReuseAddress(true);
+		if(et) {
+			et = listener.setReusePort(true);
+		}
+		if(et) {
+			et = listener.setAcceptOptions(mOptions);
+		}
+		if(et) {
+			et = listener.listen(addr,mPort,backlog,false);
+		}
+		if(et && mPort==PortNum::UNKNOWN) {
+			InetAddressV4 bound;
+			et = listener.getLocalAddress(bound,mPort);
+		}
+		if(!et) {
+			listener.closeSocket();
+			break;
+		}
+		ASyncServer *server = mFactory(i);
+		if(!server) {
+			listener.closeSocket();
+			et = ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SEINVAL);
+			break;
+		}
+		mServers.push_back(server);
+		et = server->init(ASyncServer::DEFAULT_MAX_EVENTS,engine);
+		if(et) {
+			et = server->addListener(listener);
+		}
+		if(!et) {
+			listener.closeSocket();
+		}
+	}
+	if(!et) {
+		clear();
+		return et;
+	}
+	mStop = false;
+	for(uint32_t i=0;i<reactorCount;++i) {
+		int cpu = pinThreads && !cpus.empty() ? cpus[i%cpus.size()] : -1;
+		mThreads.push_back(std::thread(&ASyncServerPool::run,this,i,cpu));
+	}
+	return et;
+}
+
+void ASyncServerPool::stop() {
+	mStop = true;
+	for(size_t i=0;i<mThreads.size();++i) {
+		mThreads[i].join();
+	}
+	mThreads.clear();
+	clear();
+}
+
+/**********************************************************************************************
+* ASyncServerPool::run -- reactor thread, pulse its server until stopped
+*
+*********************************************************************************************/
+void ASyncServerPool::run(uint32_t reactor, int cpu) {
+	if(cpu>=0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu,&cpus);
+		if(pthread_setaffinity_np(pthread_self(),sizeof(cpus),&cpus)!=0) {
+			GET_LOGGER->warn("ASyncServerPool could not pin reactor {} to cpu {}", reactor, cpu);
+		}
+	}
+	ASyncServer *server = mServers[reactor];
+	while(!mStop) {
+		if(server->pulse(PULSE_MS)<0) {
+			GET_LOGGER->error("ASyncServerPool reactor {} pulse error: {}", reactor, server->getLastError().getOSErrorString().c_str());
+			//close its listener now, the kernel keeps routing connections to it until then and nobody accepts them
+			mServers[reactor] = 0;
+			delete server;
+			break;
+		}
+	}
+}
+
+/**********************************************************************************************
+* ASyncServerPool::getUsableCPUs -- cpus the process is allowed on (taskset, cgroup cpusets), empty
+*	if the mask can't be read
+*
+*********************************************************************************************/
+std::vector<int> ASyncServerPool::getUsableCPUs() {
+	std::vector<int> usable;
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	if(sched_getaffinity(0,sizeof(cpus),&cpus)==0) {
+		for(int i=0;i<CPU_SETSIZE;++i) {
+			if(CPU_ISSET(i,&cpus)) {
+				usable.push_back(i);
+			}
+		}
+	}
+	return usable;
+}
+
+void ASyncServerPool::clear() {
+	for(size_t i=0;i<mServers.size();++i) {
+		delete mServers[i];
+	}
+	mServers.clear();
+}
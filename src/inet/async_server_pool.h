@@ -0,0 +1,76 @@
+#ifndef WSS_ASYNC_SERVER_POOL_H
+#define WSS_ASYNC_SERVER_POOL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include "../portable_types.h"
+#include "../error_type.h"
+#include "async_server.h"
+
+namespace wss {
+
+/*
+*	N ASyncServers, each pulsed by its own thread with its own listener on the same address and port (SO_REUSEPORT)
+*
+*	Rules:
+*		1.	the kernel spreads new connections over the listeners, a connection and its channel stay on the
+*			reactor that accepted it, so reactors share nothing and need no locks
+*		2.	the factory builds each reactor's ASyncServer (i.e. a subclass with the application's hooks), the
+*			server's callbacks run on that reactor's thread
+*		3.	reactor i's thread is pinned to the i'th cpu the process may run on (mod their count, see
+*			sched_getaffinity) unless pinning is turned off
+*		4.	listening on port 0 binds the first listener to a free port and the rest to the same one, see getPort
+*		5.	stop waits for every thread to finish its pulse, reactors notice within PULSE_MS
+*		6.	the socket options (setAcceptOptions) are set on each listener so accepted sockets inherit them
+*		7.	a reactor whose pulse fails deletes its server on its own thread, closing its listener so the kernel
+*			sends new connections to the reactors that are left
+*
+*	Linux only
+*/
+class ASyncServerPool {
+public:
+	enum {PULSE_MS = 50};
+	typedef std::function<ASyncServer *(uint32_t reactor)> ServerFactory;
+public:
+	ASyncServerPool(const ServerFactory &factory);
+	/*
+	*	stops the reactors and deletes their servers
+	*/
+	~ASyncServerPool();
+	/*
+	*	listen on addr:port with reactorCount reactors (0 means one per usable cpu) and start their threads, each
+	*	server is init'ed with engine.  On error nothing is left running
+	*/
+	ErrorType start(const InetAddressV4 &addr, const PortNum &port, uint32_t reactorCount = 0, bool pinThreads = true,
+		int backlog = ListenerSocket::DEFAULT_BACKLOG, ASyncServer::Engine engine = ASyncServer::ENGINE_EPOLL);
+	void stop();
+	/*
+	*	options for every accepted socket, applied to the listeners by the next start
+	*/
+	void setAcceptOptions(const SocketOptions &opts) {mOptions = opts;}
+	uint32_t getReactorCount() const {return uint32_t(mServers.size());}
+	/*
+	*	the port listened on, the one picked when start was given port 0
+	*/
+	PortNum getPort() const {return mPort;}
+private:
+	//cpu < 0 leaves the reactor's thread unpinned
+	void run(uint32_t reactor, int cpu);
+	void clear();
+	//cpus in the process's affinity mask, lowest first
+	static std::vector<int> getUsableCPUs();
+private:
+	ServerFactory				mFactory;
+	std::vector<ASyncServer*>	mServers;
+	std::vector<std::thread>	mThreads;
+	std::atomic<bool>			mStop;
+	PortNum						mPort;
+	SocketOptions				mOptions;
+private:
+	SET_NO_COPY(ASyncServerPool);
+};
+
+}
+#endif
@@ -1,5 +1,6 @@
 #include <sstream>
 #include <time.h>
+#include <algorithm>
 #include "tcp.h"
 #include "channel.h"
 #include "../wsinit.h"
@@ -7,7 +8,10 @@
 using namespace wss;
 
 ComChannel::ComChannel() : mIncomingBuffer(ReaderWriter::Create_Default_Interface()), mLastReceiveTime(time(0)), mOutBuffer(ReaderWriter::Create_Default_Interface()), mBytesSent(0),mBytesReceived(0), mBirthDate(time(0)), 
-		mBytesBuffered(0), mMarkedForDeath(false) {}
+		mBytesBuffered(0), mMarkedForDeath(false), mOutPinned(false) {}
+
+ComChannel::ComChannel(IReaderWriter *incoming, IReaderWriter *outgoing) : mIncomingBuffer(incoming), mLastReceiveTime(time(0)), mOutBuffer(outgoing), mBytesSent(0),mBytesReceived(0), mBirthDate(time(0)), 
+		mBytesBuffered(0), mMarkedForDeath(false), mOutPinned(false) {}
 
 int ComChannel::bufferIn() {
 	int bytesIn = onBufferIn();
@@ -24,13 +28,102 @@ bool ComChannel::hasDataToSend() {
 ErrorType ComChannel::bufferOut( const void * data, size_t len )
 {
 	ErrorType et;
+	if(len==0) {
+		return et;
+	}
 	size_t outlen = mOutBuffer.write(data, len);
-	assert(outlen == len);
+	if(outlen == ReaderWriter::STREAM_ERROR) {
+		//nothing was written so there is nothing to take back
+		return ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SENOBUFS);
+	}
+	if(outlen != len) {
+		//bounded buffer is full, don't leave a partial message behind
+		mOutBuffer.erase(mOutBuffer.tellWrite()-outlen, outlen);
+		return ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SENOBUFS);
+	}
 	//VALUE_METRIC2("Channel::bufferOutBytes", outlen);
 	return et;
 }
 
+ErrorType ComChannel::bufferOut( const SharedBuffer &sb )
+{
+	ErrorType et;
+	size_t outlen = mOutBuffer.writeShared(sb);
+	if(outlen != sb.size()) {
+		//bounded buffer is full, don't leave a partial message behind
+		mOutBuffer.erase(mOutBuffer.tellWrite()-outlen, outlen);
+		return ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SENOBUFS);
+	}
+	return et;
+}
+
+void ComChannel::reserveOutHeadroom(uint32_t bytes) {
+	mOutBuffer.reserveHeadroom(bytes);
+}
+
+ErrorType ComChannel::bufferOutFront( const void * data, size_t len )
+{
+	ErrorType et;
+	if(len==0) {
+		return et;
+	}
+	if(mOutPinned) {
+		return ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SEWOULDBLOCK);
+	}
+	if(mOutBuffer.prepend(data, len) != len) {
+		return ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SENOBUFS);
+	}
+	return et;
+}
+
+ErrorType ComChannel::forwardTo( ComChannel &to, size_t len )
+{
+	ErrorType et;
+	ReaderWriter &out = to.mOutBuffer;
+	if(out.fixedCapacity() && out.capacity()-out.size() < len) {
+		return ErrorType(ErrorType::codeOSSpecific,BaseSocketInterface::SENOBUFS);
+	}
+	mIncomingBuffer.splice(out, 0, len);
+	return et;
+}
+
+size_t ComChannel::bufferIn(const void *data, size_t len) {
+	size_t bytesIn = mIncomingBuffer.write(data, len);
+	if(bytesIn>0) {
+		mBytesReceived+=bytesIn;
+		setLastReceiveTime(time(0));
+	}
+	return bytesIn;
+}
+
+size_t ComChannel::bufferIn(const SharedBuffer &received) {
+	size_t bytesIn = mIncomingBuffer.writeShared(received);
+	if(bytesIn>0) {
+		mBytesReceived+=bytesIn;
+		setLastReceiveTime(time(0));
+	}
+	return bytesIn;
+}
+
+size_t ComChannel::getOutSpans(ConstBufferSpan *spans, size_t maxSpans) {
+	size_t count = mOutBuffer.rawSpans(0, mOutBuffer.size(), spans, maxSpans);
+	mOutPinned = count!=0;
+	return count;
+}
+
+void ComChannel::sentOut(size_t bytes) {
+	mOutPinned = false;
+	if(bytes>0) {
+		mBytesSent+=bytes;
+		removeFromOutBuffer(uint32_t(bytes));
+	}
+}
+
 int ComChannel::sendData() {
+	if(mOutPinned) {
+		//the event loop that pinned the buffer is sending it
+		return 0;
+	}
 	int writtenBytes = onSendData();
 	if(writtenBytes>0) {
 		mBytesSent+=writtenBytes;
@@ -42,7 +135,14 @@ void ComChannel::setDeath() {
 }
 
 void ComChannel::removeFromBuffer(uint32_t bytesToRemove) {
-	mIncomingBuffer.erase(0, bytesToRemove);
+	mIncomingBuffer.consume(bytesToRemove);
+}
+
+void ComChannel::shrinkBuffers() {
+	mIncomingBuffer.shrinkToFit();
+	if(!mOutPinned) {
+		mOutBuffer.shrinkToFit();
+	}
 }
 
 NativeTimeType ComChannel::getLastReceiveTime() {
@@ -56,13 +156,27 @@ void ComChannel::setLastReceiveTime(NativeTimeType now) {
 ComChannel::~ComChannel() {}
 
 void ComChannel::removeFromOutBuffer(uint32_t bytesToRemove) {
-	mOutBuffer.erase(0, bytesToRemove);
+	mOutBuffer.consume(bytesToRemove);
 }
 
 TCPComChannel::TCPComChannel(TCPServerSocket *ss) 
 	: ComChannel(), mSock(ss) {
-	mSock->setNonBlocking();
-	mSock->setNagelOff();
+	applySocketDefaults();
+}
+
+TCPComChannel::TCPComChannel(TCPServerSocket *ss, IReaderWriter *incoming, IReaderWriter *outgoing) 
+	: ComChannel(incoming, outgoing), mSock(ss) {
+	applySocketDefaults();
+}
+
+//non blocking, no nagel.  A socket accepted from a listener with setAcceptOptions already is, skip the system calls
+void TCPComChannel::applySocketDefaults() {
+	if(!mSock->isNonBlocking()) {
+		mSock->setNonBlocking();
+	}
+	if(!mSock->isNagelOff()) {
+		mSock->setNagelOff();
+	}
 }
 
 bool TCPComChannel::getPeerAddress(InetAddressV4 &addr, PortNum &portNum) {
@@ -80,6 +194,10 @@ TCPComChannel::~TCPComChannel() {
 	}
 }
 
+BaseSocketInterface::SOCKET TCPComChannel::getNativeHandle() const {
+	return mSock ? mSock->getNativeHandle() : BaseSocketInterface::BAD_SOCKET;
+}
+
 ErrorType TCPComChannel::getLastSocketError() {
 	if(mSock) {
 		return mSock->getLastError();
@@ -89,17 +207,48 @@ ErrorType TCPComChannel::getLastSocketError() {
 }
 
 int TCPComChannel::onBufferIn() {
-	char buf[512];
 	int total = 0;
-	int bytes = mSock->receive(buf,512);
-	if(bytes>0) {
-		setLastReceiveTime(time(0));
-		mIncomingBuffer.write(buf, bytes);
-		total+=bytes;
-		while((bytes = mSock->receive(buf,512))>0) {
-			mIncomingBuffer.write(buf, bytes);
+	int bytes = 0;
+	size_t space = 0;
+	do {
+		//receive straight into the incoming buffer's tail block, after the first pass that is a whole block per recv
+		void *tail = mIncomingBuffer.prepare(1, space);
+		if(tail) {
+			BufferSpan span(tail, space);
+			bytes = mSock->receivev(&span, 1);
+			if(bytes>0) {
+				mIncomingBuffer.commit(bytes);
+			}
+		} else if(mIncomingBuffer.fixedCapacity() && mIncomingBuffer.size()>=mIncomingBuffer.capacity()) {
+			//bounded buffer is full, leave the rest in the socket until the application removes some
+			bytes = BaseSocketInterface::SOCK_ERROR;
+			break;
+		} else {
+			//stream can't hand out its memory so copy in
+			char buf[512];
+			uint32_t room = sizeof(buf);
+			if(mIncomingBuffer.fixedCapacity()) {
+				room = uint32_t((std::min)(size_t(room),mIncomingBuffer.capacity()-mIncomingBuffer.size()+1));
+			}
+			space = room-1;
+			bytes = mSock->receive(buf, room);
+			if(bytes>0) {
+				mIncomingBuffer.write(buf, bytes);
+			}
+		}
+		if(bytes>0) {
 			total += bytes;
 		}
+	//a short read means the socket is drained, no need to make another call just to get EWOULDBLOCK
+	} while(bytes>0 && size_t(bytes)==space);
+
+	if(total>0) {
+		setLastReceiveTime(time(0));
+		if(bytes==0) {
+			//peer closed right behind the data (a block sized read went back for more), the caller only sees
+			//the bytes so report the end here
+			setDeath();
+		}
 		return total;
 	} else {
 		if(bytes==0 && !mSock->getLastError()) {
@@ -113,13 +262,22 @@ int TCPComChannel::onSendData() {
 	int total_sent = 0;
 	if(hasDataToSend())
 	{
-		size_t raw_size = 0;
+		//hand the socket as many blocks as it will take in one writev rather than a send per block
+		ConstBufferSpan spans[BaseSocketInterface::MAX_IOVEC];
+		size_t out_size = getOutBuffer().size();
+		size_t span_bytes = 0;
 		int sent = 0;
-		const char * raw_ptr = 0;
 		do 
 		{
-			raw_ptr = reinterpret_cast<const char *>(getOutBuffer().raw(total_sent, raw_size));
-			sent = mSock->send(raw_ptr, raw_size);
+			uint32_t count = (uint32_t)getOutBuffer().rawSpans(total_sent, out_size-total_sent, spans, BaseSocketInterface::MAX_IOVEC);
+			if(count==0) {
+				break;
+			}
+			span_bytes = 0;
+			for(uint32_t i=0;i<count;++i) {
+				span_bytes += spans[i].Length;
+			}
+			sent = mSock->sendv(spans, count);
 			if(BaseSocketInterface::SOCK_ERROR == sent)
 			{
 				//total_sent bytes will still be removed even if 
@@ -135,12 +293,12 @@ int TCPComChannel::onSendData() {
 				total_sent += sent;
 			}
 		} 
-		//Keep sending data as long as we send the whole chunk
+		//Keep sending data as long as we send everything we handed the socket
 		//Sending a partial chunk is not an error and the data will remain in the buffer for the next call.
-		while (raw_size == (uint32_t)sent && (uint32_t)total_sent < getOutBuffer().size());
+		while (span_bytes == (size_t)sent && (size_t)total_sent < out_size);
 
 		//VALUE_METRIC2("Channel::socketOutBytes", total_sent);
-		GET_LOGGER->trace("TCPComChannel - Sent {}/{} bytes", total_sent, getOutBuffer().size());
+		GET_LOGGER->trace("TCPComChannel - Sent {}/{} bytes", total_sent, out_size);
 
 		//Remove any data we sent
 		removeFromOutBuffer(total_sent);
@@ -6,6 +6,7 @@
 #include "../portable_types.h"
 #include "../io/readerwriter.h"
 #include "../error_type.h"
+#include "socket_typedefs.h"
 
 namespace wss {
 	class TCPServerSocket;
@@ -22,10 +23,17 @@ namespace wss {
 class ComChannel  {
 public: //static
 	ComChannel();
+	/*
+	*	Channel that buffers through the given streams (i.e. ReaderWriter::Create_Ring_Interface for bounded
+	*	small message channels), the channel takes ownership of both
+	*/
+	ComChannel(IReaderWriter *incoming, IReaderWriter *outgoing);
 	/**
 	* @return  int 
 	*  
 	*  calls to decedents to buffer incoming bytes but tracks bytes for stats
+	*  if the incoming buffer is bounded (fixedCapacity) and already full -1 is returned without reading the socket,
+	*  remove data from the incoming buffer before calling again
 	*/
 	int bufferIn();
 	/**
@@ -70,6 +78,10 @@ public: //static
 	*/
 	void removeFromBuffer(uint32_t bytesToRemove);
 	/*
+	*	Release buffer memory beyond what the buffered data needs, for channels that have gone quiet
+	*/
+	void shrinkBuffers();
+	/*
 	*	return the number of bytes sent through this comchannel, stat info
 	*/
 	uint64_t getBytesSent() const {return mBytesSent;}
@@ -87,8 +99,53 @@ public: //static
 	const ReaderWriter &getIncomingBuffer() const {return mIncomingBuffer;}
 	/*
 	*	Given a container write it to the outgoing buffer
+	*	if the outgoing buffer is bounded and len does not fit nothing is buffered and SENOBUFS is returned
 	*/
 	ErrorType bufferOut(const void * data, size_t len);
+	/*
+	*	Same as above but the out buffer holds a ref on the payload rather than a copy, build the SharedBuffer
+	*	once and hand it to every channel to fan a message out
+	*/
+	ErrorType bufferOut(const SharedBuffer &sb);
+	/*
+	*	Keep bytes of headroom in front of the outgoing buffer whenever it is empty, so a header put in front
+	*	with bufferOutFront is copied into the head block rather than needing one of its own
+	*/
+	void reserveOutHeadroom(uint32_t bytes);
+	/*
+	*	Put len bytes in front of everything in the outgoing buffer, i.e. the length header of a message that
+	*	was just buffered with bufferOut into an empty buffer.  SENOBUFS if the outgoing buffer can't prepend
+	*	(ring buffers), SEWOULDBLOCK while an event loop is sending its front (getOutSpans)
+	*/
+	ErrorType bufferOutFront(const void *data, size_t len);
+	/*
+	*	Move len bytes from the front of our incoming buffer to the outgoing buffer of to, for relaying traffic.
+	*	Whole buffer blocks change hands without being copied.  If to's outgoing buffer is bounded and len does
+	*	not fit nothing is moved and SENOBUFS is returned
+	*/
+	ErrorType forwardTo(ComChannel &to, size_t len);
+	/*
+	*	For an event loop that does the socket I/O itself (i.e. io_uring):  buffer len bytes it already received
+	*	on this channel, tracked for stats like bufferIn.  Returns the bytes buffered, fewer than len only if the
+	*	incoming buffer is bounded and fills up
+	*/
+	size_t bufferIn(const void *data, size_t len);
+	/*
+	*	Same as above but the incoming buffer holds a ref on received's blocks rather than a copy (unless it is
+	*	bounded, which copies)
+	*/
+	size_t bufferIn(const SharedBuffer &received);
+	/*
+	*	For an event loop that does the socket I/O itself:  up to maxSpans spans over the front of the outgoing
+	*	buffer.  The bytes they cover stay put until sentOut, meanwhile the buffer is only appended to and
+	*	sendData / shrinkBuffers leave it alone
+	*/
+	size_t getOutSpans(ConstBufferSpan *spans, size_t maxSpans);
+	/*
+	*	the socket took bytes from the front of the spans getOutSpans handed out, remove them from the outgoing
+	*	buffer and count them as sent
+	*/
+	void sentOut(size_t bytes);
 
 	virtual ~ComChannel();
 protected:
@@ -110,6 +167,7 @@ private:
 	NativeTimeType		mBirthDate;
 	uint64_t				mBytesBuffered;
 	bool					mMarkedForDeath;
+	bool					mOutPinned;		//an event loop is sending the front of mOutBuffer (getOutSpans)
 };
 
 /*
@@ -118,13 +176,20 @@ private:
 class TCPComChannel : public ComChannel {
 public:
 	TCPComChannel(TCPServerSocket *ss);
+	TCPComChannel(TCPServerSocket *ss, IReaderWriter *incoming, IReaderWriter *outgoing);
 	virtual bool getPeerAddress(InetAddressV4 &addr, PortNum &portNum);
 	virtual int getByteCount();
 	virtual ~TCPComChannel();
 	ErrorType getLastSocketError();
+	/*
+	*	OS socket of the channel, BAD_SOCKET if it has none
+	*/
+	BaseSocketInterface::SOCKET getNativeHandle() const;
 protected:
 	virtual int onBufferIn();
 	virtual int onSendData();
+private:
+	void applySocketDefaults();
 private:
 	TCPServerSocket	*mSock;
 };
@@ -34,12 +34,26 @@ ErrorType BaseSocketInterface::setReceiveBuffer(const int &opt) {
 }
 
 ErrorType BaseSocketInterface::setReuseAddress(const bool &opt) {
-	if(SOCK_ERROR==(setsockopt(getSocket(), SOL_SOCKET, SO_REUSEADDR, (char *) &opt, sizeof(opt)))) {
+	//the option is an int, handing the kernel a 1 byte bool fails with EINVAL (and closed the socket)
+	int val = opt ? 1 : 0;
+	if(SOCK_ERROR==(setsockopt(getSocket(), SOL_SOCKET, SO_REUSEADDR, (char *) &val, sizeof(val)))) {
 		return setLastErrorCode(), ErrorType(ErrorType::codeOSSpecific,getLastErrorCode());
 	}
 	return ErrorType();
 }
 
+ErrorType BaseSocketInterface::setReusePort(const bool &opt) {
+#ifdef SO_REUSEPORT
+	int val = opt ? 1 : 0;
+	if(SOCK_ERROR==(setsockopt(getSocket(), SOL_SOCKET, SO_REUSEPORT, (char *) &val, sizeof(val)))) {
+		return setLastErrorCode(), ErrorType(ErrorType::codeOSSpecific,getLastErrorCode());
+	}
+	return ErrorType();
+#else
+	return ErrorType(ErrorType::codeOSSpecific,SNO_OS_SUPPORT);
+#endif
+}
+
 ErrorType BaseSocketInterface::getLastError() {
 	if(getLastErrorCode()!=SNO_ERROR) {
 		return ErrorType(ErrorType::codeOSSpecific,getLastErrorCode());
@@ -53,16 +67,34 @@ ErrorType BaseSocketInterface::setNagelOff() {
 	if(SOCK_ERROR==retVal) {
 		return ErrorType(ErrorType::codeOSSpecific,getLastErrorCode());
 	}
+	mNagelOff = true;
 	return ErrorType();
 }
 
+ErrorType BaseSocketInterface::applyOptions(const SocketOptions &opts) {
+	ErrorType et;
+	if(opts.NagelOff) {
+		et = setNagelOff();
+	}
+	if(et && opts.LingerOff) {
+		et = setLingerOff();
+	}
+	if(et && opts.SendBuffer>0) {
+		et = setSendBuffer(opts.SendBuffer);
+	}
+	if(et && opts.ReceiveBuffer>0) {
+		et = setReceiveBuffer(opts.ReceiveBuffer);
+	}
+	return et;
+}
+
 
 BaseSocketInterface::BaseSocketInterface(SOCKET s) 
-: mSock(s), mIsBlocking(true), mLastError(SNO_ERROR) {
+: mSock(s), mIsBlocking(true), mNagelOff(false), mLastError(SNO_ERROR) {
 }
 
 BaseSocketInterface::BaseSocketInterface(SOCKET s, bool bIsBlocking) 
-	: mSock(s), mIsBlocking(bIsBlocking), mLastError(SNO_ERROR) {
+	: mSock(s), mIsBlocking(bIsBlocking), mNagelOff(false), mLastError(SNO_ERROR) {
 }
 
 void BaseSocketInterface::setLastErrorCode(ERROR_CODE e) {
@@ -125,11 +157,11 @@ ErrorType BaseSocketInterface::bind(const InetAddressV4 &addr) {
 ErrorType BaseSocketInterface::getLocalAddrAndPort(InetAddressV4 &addr, PortNum &port) {
 	struct ::sockaddr_in sockaddr;
 	socklen_t size = sizeof(::sockaddr_in);
-	if(SOCK_ERROR!=::getsockname(getSocket(),(struct sockaddr *)&sockaddr,&size)) {
-		addr = sockaddr.sin_addr;
-		port = ntohs(sockaddr.sin_port);
+	if(SOCK_ERROR==::getsockname(getSocket(),(struct sockaddr *)&sockaddr,&size)) {
 		return setLastErrorCode(), ErrorType(ErrorType::codeOSSpecific,getLastErrorCode());
 	}
+	addr = sockaddr.sin_addr;
+	port = ntohs(sockaddr.sin_port);
 	return ErrorType();
 }
 
@@ -202,25 +234,75 @@ ErrorType TCPSocketInterface::connect(const InetAddressV4 &addr, short nPort, ui
 	} else {
 		struct timeval tv;
 		tv.tv_sec = waitTimeMS/1000;
-		tv.tv_usec = waitTimeMS%1000;
+		tv.tv_usec = (waitTimeMS%1000)*1000;
 		return connect(addr,nPort,&tv);
 	}
 }
 
+//the connection at the front of the backlog went away (or the call was interrupted), take the next one
+static bool isAcceptRetry(int e) {
+	switch(e) {
+	case ECONNABORTED:
+	case EINTR:
+	case EPROTO:
+	//linux passes network errors already pending on the new connection to accept
+	case ENETDOWN:
+	case ENOPROTOOPT:
+	case EHOSTDOWN:
+	case EHOSTUNREACH:
+	case ENETUNREACH:
+	case EOPNOTSUPP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//out of descriptors or memory, the listener is fine and accepting works again once some are freed
+static bool isAcceptExhausted(int e) {
+	return e==EMFILE || e==ENFILE || e==ENOBUFS || e==ENOMEM;
+}
+
 TCPSocketInterface* TCPSocketInterface::accept() {
 	InetAddressV4 addr;
 	PortNum	port;
 	struct sockaddr_in peer;
-	socklen_t i = sizeof(peer);
-	SOCKET desc = (SOCKET)::accept(getSocket(),(struct sockaddr *) &peer,&i);
+	socklen_t i;
+	SOCKET desc;
+	do {
+		i = sizeof(peer);
+#ifdef WSS_LINUX
+		//linux sockets don't inherit O_NONBLOCK from the listener, set it in the same call rather than with fcntl after
+		desc = (SOCKET)::accept4(getSocket(),(struct sockaddr *) &peer,&i,SOCK_CLOEXEC | (isNonBlocking() ? SOCK_NONBLOCK : 0));
+#else
+		desc = (SOCKET)::accept(getSocket(),(struct sockaddr *) &peer,&i);
+#endif
+	} while(desc==BAD_SOCKET && isAcceptRetry(errno));
 	if(desc==BAD_SOCKET) {
-		setLastErrorCode();
+		if(isAcceptExhausted(errno)) {
+			//not the listener's fault, don't close it
+			setLastErrorCodeKeepOpen(ERROR_CODE(errno));
+		} else {
+			setLastErrorCode();
+		}
 		return 0;
 	}
     addr = peer.sin_addr;
 	port = ntohs(peer.sin_port);
 	setLastErrorCode(SNO_ERROR);
-	return (new TCPSocketInterface(desc, addr, port,IsBlocking()));
+	TCPSocketInterface *tcp = new TCPSocketInterface(desc, addr, port,IsBlocking());
+	tcp->setNagelState(isNagelOff());
+	return tcp;
+}
+
+TCPSocketInterface* TCPSocketInterface::adoptAccepted(SOCKET s) {
+	TCPSocketInterface *tcp = new TCPSocketInterface(s, InetAddressV4(), PortNum(), IsBlocking());
+	tcp->setNagelState(isNagelOff());
+	return tcp;
+}
+
+ErrorType TCPSocketInterface::setAcceptOptions(const SocketOptions &opts) {
+	return applyOptions(opts);
 }
 
 ErrorType TCPSocketInterface::getPeerAddress(InetAddressV4 &addr, PortNum &port) {
@@ -66,6 +66,7 @@ namespace wss {
 		*/
 		operator unsigned short() const {return m_nPort;}
 		PortNum(const PortNum &r) : m_nPort(r.m_nPort) {}
+		PortNum &operator=(const PortNum &r) {m_nPort=r.m_nPort;return *this;}
 		PortNum &operator=(unsigned short s) {m_nPort=s;return *this;}
 	private:
 		unsigned short m_nPort;
@@ -3,7 +3,9 @@
 #include "socket_typedefs.h"
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <sys/resource.h>
+#include <sys/uio.h>
 #include "../wsinit.h"
 
 using namespace wss;
@@ -132,6 +134,48 @@ int TCPSocketInterface::send(const char *buf, uint32_t size) {
 }
 
 
+//same return values as send
+int TCPSocketInterface::sendv(const ConstBufferSpan *spans, uint32_t count) {
+	struct iovec vec[MAX_IOVEC];
+	int n = count<uint32_t(MAX_IOVEC) ? int(count) : MAX_IOVEC;
+	for(int i=0;i<n;i++) {
+		vec[i].iov_base = const_cast<void*>(spans[i].Data);
+		vec[i].iov_len = spans[i].Length;
+	}
+	int retVal = (int)::writev(getSocket(),vec,n);
+	if(retVal==SOCK_ERROR) {
+		int nError = errno;
+		setLastErrorCode(ERROR_CODE(nError));
+		if(SEWOULDBLOCK==nError) {
+			return 0;
+		}
+	}
+	return retVal;
+}
+
+//same return values as receive but no null terminator is written, and an orderly shutdown only closes the
+//read side so what is still buffered for the peer can be sent
+int TCPSocketInterface::receivev(const BufferSpan *spans, uint32_t count) {
+	struct iovec vec[MAX_IOVEC];
+	int n = count<uint32_t(MAX_IOVEC) ? int(count) : MAX_IOVEC;
+	for(int i=0;i<n;i++) {
+		vec[i].iov_base = spans[i].Data;
+		vec[i].iov_len = spans[i].Length;
+	}
+	int ret = (int)::readv(getSocket(),vec,n);
+	if(ret==SOCK_ERROR) {
+		int nError = errno;
+		if((nError!=SEWOULDBLOCK)) {
+			ret = 0;
+		}
+		setLastErrorCode(ERROR_CODE(nError));
+	} else if (ret==0) {
+		setLastErrorCode(SNO_ERROR);
+		setSocketState(READ_CLOSED);
+	}
+	return ret;
+}
+
 ///////////////////////////////////////////////////
 //The shutdown() call causes all or part of a full-duplex connection on the 
 //socket associated with s to be shut down. If how is 0, further receives will be 
@@ -174,69 +218,76 @@ ErrorType TCPSocketInterface::shutwrite() {
 //	is connected (which occurs only when the three-way handshake completes).  A pending error causes a 
 //	socket to be both readable and writable
 //
-//  null wait time mean NO WAIT
+//  null wait time mean NO WAIT, a zero wait time waits until the connect completes
+//  waits with poll, select can't take a descriptor >= FD_SETSIZE
 ///////////////////////////////////////////////////////////////////////////////////
 ErrorType TCPSocketInterface::connect(const InetAddressV4 &addr, short nPort, struct timeval *waitTime) {
+	ErrorType et = beginConnect(addr,nPort);
+	if(!et || !isInState(CONNECTING)) {
+		return et;
+	}
+	int waitMS = 0;
+	if(waitTime) {
+		waitMS = (waitTime->tv_sec==0 && waitTime->tv_usec==0) ? -1 : int(waitTime->tv_sec*1000 + waitTime->tv_usec/1000);
+	}
+	struct pollfd pfd;
+	pfd.fd = getSocket();
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+	int nSockets;
+	do {
+		nSockets = ::poll(&pfd,1,waitMS);
+	} while(nSockets==SOCK_ERROR && errno==EINTR);
+	//if poll returns an error set the error (which will close the socket and return)
+	if(nSockets==SOCK_ERROR) {
+		SET_AND_RETURN;
+	} else if (nSockets==0) {
+		//if poll returns 0 then this is a timeout situation
+		setLastErrorCode(SETIMEDOUT);
+		return ErrorType(ErrorType::codeOSSpecific,SETIMEDOUT);
+	}
+	//writable, or POLLERR/POLLHUP, SO_ERROR says which
+	return finishConnect();
+}
+
+ErrorType TCPSocketInterface::beginConnect(const InetAddressV4 &addr, short nPort) {
 	struct sockaddr_in sockaddr;
 	sockaddr.sin_addr = addr.getAddress();
 	sockaddr.sin_family = AF_INET;
-	sockaddr.sin_port = htons(nPort);
+	sockaddr.sin_port = htons((unsigned short)nPort);
 	setSocketState(CONNECTING);
 	int retVal = ::connect(getSocket(),(struct sockaddr *) &sockaddr,sizeof(sockaddr_in));
 	//did the connect work?
 	if(retVal==SOCK_ERROR) {
 		int nError = errno;
-		//if not but because we are non blocking
+		//if not but because we are non blocking, it finishes later
 		if(EWOULDBLOCK==nError || EINPROGRESS==nError) {
-			fd_set readSet, writeSet, exceptionSet;
-			FD_ZERO(&writeSet);
-			FD_ZERO(&readSet);
-			FD_ZERO(&exceptionSet);
-			FD_SET(getSocket(),&writeSet);
-			FD_SET(getSocket(),&readSet);
-			int nSockets = select((int)getSocket()+1,&readSet,&writeSet,&exceptionSet,waitTime);
-			//if select returns an error set the error (which will close the socket and return)
-			if(nSockets==SOCK_ERROR) {
-				SET_AND_RETURN;
-			} else if (nSockets==0) {
-				//if select returns 0 then this is a timeout situation
-				setLastErrorCode(SETIMEDOUT);
-				return ErrorType(ErrorType::codeOSSpecific,SETIMEDOUT);
-			} else {
-				// if the socket is in the exception set OR if in BOTH read and write sets we have an error
-				if (FD_ISSET(getSocket(), &exceptionSet)) {
-					//socket is in exception set close it
-					setLastErrorCode(SECONNREFUSED);
-					closeSocket();
-					return ErrorType(ErrorType::codeOSSpecific,getLastErrorCode());
-				} else if (FD_ISSET(getSocket(),&writeSet) || FD_ISSET(getSocket(),&readSet)) {
-					int error;
-					socklen_t len = sizeof(error);
-					if(getsockopt(getSocket(),SOL_SOCKET,SO_ERROR,(char *)&error,&len) < 0) {
-						WSInit::get().getLogger()->error("There is a pending error on the socket.");
-						setLastErrorCode(SECONNREFUSED);
-					} else {
-						if(error==SNO_ERROR) {
-							setLastErrorCode(SNO_ERROR);
-							setSocketState(CONNECTED);
-						} else {
-							setLastErrorCode(BaseSocketInterface::ERROR_CODE(error));
-							return ErrorType(ErrorType::codeOSSpecific,getLastErrorCode());
-						}
-					}
-				} else {
-					WSInit::get().getLogger()->error("Select error:  Socket is not in any fd_set???????");
-					setLastErrorCode(SENOTSOCK);
-					return getLastError();
-				}
-			}
-		} else {
-			setLastErrorCode(ERROR_CODE(nError));
-			return INET_SOCK_ERROR;
+			return ErrorType();
 		}
-	} else {
-		setLastErrorCode(SNO_ERROR);
-		setSocketState(CONNECTED);
+		setLastErrorCode(ERROR_CODE(nError));
+		closeSocket();
+		return ErrorType(ErrorType::codeOSSpecific,nError);
+	}
+	setLastErrorCode(SNO_ERROR);
+	setSocketState(CONNECTED);
+	return ErrorType();
+}
+
+ErrorType TCPSocketInterface::finishConnect() {
+	int error;
+	socklen_t len = sizeof(error);
+	if(getsockopt(getSocket(),SOL_SOCKET,SO_ERROR,(char *)&error,&len) < 0) {
+		WSInit::get().getLogger()->error("There is a pending error on the socket.");
+		setLastErrorCode(SECONNREFUSED);
+		closeSocket();
+		return ErrorType(ErrorType::codeOSSpecific,SECONNREFUSED);
+	}
+	if(error!=SNO_ERROR) {
+		setLastErrorCode(BaseSocketInterface::ERROR_CODE(error));
+		closeSocket();
+		return ErrorType(ErrorType::codeOSSpecific,error);
 	}
+	setLastErrorCode(SNO_ERROR);
+	setSocketState(CONNECTED);
 	return ErrorType();
 }
@@ -31,6 +31,8 @@ namespace wss {
 		typedef ::socklen_t socklen_t;
 		///Error returned from functions like send and recieve if an error occurred.
 		static const int SOCK_ERROR = -1;
+		///max number of buffers handed to a single writev/readv
+		static const int MAX_IOVEC = 256;
 		///A mapping of the OS specific error an generic error name we can use cross platform
 		enum ERROR_CODE {
 			SNO_OS_SUPPORT	= -1,
@@ -4,9 +4,21 @@
 
 #include "socket_typedefs.h"
 #include "../error_type.h"
+#include "../buffer/buffer_span.h"
 #include "inetaddress_v4.h"
 
 namespace wss {
+	/**
+	*	Socket options applied as one set, i.e. once to a listening socket so the sockets accepted from it
+	*	start out with them (see TCPSocketInterface::setAcceptOptions)
+	*/
+	struct SocketOptions {
+		bool	NagelOff;		//TCP_NODELAY
+		bool	LingerOff;		//SO_LINGER off
+		int		SendBuffer;		//SO_SNDBUF, 0 leaves the OS default
+		int		ReceiveBuffer;	//SO_RCVBUF, 0 leaves the OS default
+		SocketOptions() : NagelOff(true), LingerOff(false), SendBuffer(0), ReceiveBuffer(0) {}
+	};
 	/**
 	*	@author Demetrius Comes
 	*
@@ -21,6 +33,8 @@ namespace wss {
 		typedef OSSOCKTRAITS::socklen_t socklen_t;
 		///Error returned from functions like send and recieve if an error occurred.
 		static const int SOCK_ERROR = OSSOCKTRAITS::SOCK_ERROR;
+		///max number of spans sendv/receivev will hand the OS in one call
+		static const int MAX_IOVEC = OSSOCKTRAITS::MAX_IOVEC;
 		enum ERROR_CODE {
 			SNO_OS_SUPPORT	= OSSOCKTRAITS::SNO_OS_SUPPORT,
 			SNO_ERROR		= OSSOCKTRAITS::SNO_ERROR,
@@ -116,6 +130,14 @@ namespace wss {
 		*/
 		ErrorType setReuseAddress(const bool &opt);
 		/**
+		* @return  ErrorType 
+		* @param  const bool &opt
+		*  
+		*  SO_REUSEPORT, lets several sockets bind the same address and port.  Connections to the port are
+		*	spread over the listening sockets by the kernel.  Set on every socket before bind
+		*/
+		ErrorType setReusePort(const bool &opt);
+		/**
 		* @date  11/6/2003 10:41:51 AM
 		* @return  void 
 		*  
@@ -159,6 +181,20 @@ namespace wss {
 		*/
 		ErrorType setNagelOff();
 		/**
+		* @return  bool 
+		*  
+		*  returns true if the nagel algorithm is known to be off, set by setNagelOff or inherited from the
+		*	listening socket this socket was accepted from
+		*/
+		bool isNagelOff() const {return mNagelOff;}
+		/**
+		* @return  ErrorType 
+		* @param  const SocketOptions &opts
+		*  
+		*  sets every option in opts, stops at the first that fails
+		*/
+		ErrorType applyOptions(const SocketOptions &opts);
+		/**
 		* @date  11/7/2003 10:18:52 PM
 		* @return  uint32 
 		*  
@@ -235,6 +271,12 @@ namespace wss {
 		*  returns local address and port of this socket
 		*/
 		ErrorType getLocalAddrAndPort(InetAddressV4 &addr, PortNum &port);
+		/**
+		* @return  SOCKET 
+		*  
+		*  the OS socket, for registering with an event loop.  Don't close it
+		*/
+		SOCKET getNativeHandle() const {return mSock;}
 	protected:
 		/**
 		* @date  11/6/2003 10:06:06 AM
@@ -267,10 +309,16 @@ namespace wss {
 		ERROR_CODE getLastErrorCode() const {return mLastError;}
 		void setLastErrorCode(ERROR_CODE e);
 		void setLastErrorCode(); 
+		/*
+		*	record an error that doesn't end the socket (i.e. a listener out of descriptors), setLastErrorCode closes it
+		*/
+		void setLastErrorCodeKeepOpen(ERROR_CODE e) {mLastError = e;}
 		void setBlocking(bool b) {mIsBlocking = b;}
+		void setNagelState(bool off) {mNagelOff = off;}
 	private:
 		SOCKET			mSock;				//the actual socket fd
 		bool			mIsBlocking;		//true if nonblock has been called
+		bool			mNagelOff;			//true if TCP_NODELAY is set
 		ERROR_CODE		mLastError;			//last error on socket
 	};
 	/**
@@ -366,6 +414,28 @@ namespace wss {
 		*/
 		int receive(char *pBuf, uint32_t nSizeOfBuf);
 		/**
+		* @return  int 
+		* @param  const ConstBufferSpan *spans
+		* @param  uint32_t count
+		*  
+		*  gather version of send, sends the spans in order with a single call (writev)
+		*	at most MAX_IOVEC spans are sent per call
+		*	return values are the same as send
+		*/
+		int sendv(const ConstBufferSpan *spans, uint32_t count);
+		/**
+		* @return  int 
+		* @param  const BufferSpan *spans
+		* @param  uint32_t count
+		*  
+		*  scatter version of receive, fills the spans in order with a single call (readv)
+		*	at most MAX_IOVEC spans are filled per call
+		*	return values are the same as receive, however unlike receive the data is NOT null terminated
+		*	so every byte of every span can be used.  A 0 for an orderly shutdown leaves the socket open
+		*	(READ_CLOSED) so data can still be sent, the caller closes it.  On error it is closed
+		*/
+		int receivev(const BufferSpan *spans, uint32_t count);
+		/**
 		* @date  11/6/2003 1:10:24 PM
 		* @return  ErrorType 
 		*  
@@ -414,9 +484,27 @@ namespace wss {
 		*	if the connect fails for any reason besides a timeout (in which the ErrorType.getOSError()
 		*		will return SETIMEOUT) the socket will be closed.
 		*
+		*	waits with poll so any descriptor works, select can't take one >= FD_SETSIZE
 		*/
 		ErrorType connect(const InetAddressV4 &addr, short nPort, struct timeval *waitTime);
 		/**
+		* @return  ErrorType 
+		* @param  const InetAddressV4 &addr
+		* @param  short nPort
+		*  
+		*  starts a connect and returns without waiting.  No error and isConnected() means it is done,
+		*	no error and isInState(CONNECTING) means the socket becomes writable once it completes and
+		*	finishConnect says how it went.  On error the socket is closed
+		*/
+		ErrorType beginConnect(const InetAddressV4 &addr, short nPort);
+		/**
+		* @return  ErrorType 
+		*  
+		*  outcome of a connect from beginConnect once the socket is writable (or in error), closes
+		*	the socket if the connect failed
+		*/
+		ErrorType finishConnect();
+		/**
 		* @date  11/6/2003 1:12:29 PM
 		* @return  ErrorType 
 		* @param  int backlog
@@ -435,6 +523,22 @@ namespace wss {
 		*/
 		TCPSocketInterface* accept();
 		/**
+		* @return  ErrorType 
+		* @param  const SocketOptions &opts
+		*  
+		*  applies opts to this listening socket, the OS copies them to each socket accepted from it (Linux does
+		*	for every option in SocketOptions) so no per connection setsockopt is needed
+		*/
+		ErrorType setAcceptOptions(const SocketOptions &opts);
+		/**
+		* @return  TCPSocketInterface* 
+		* @param  SOCKET s
+		*  
+		*  wraps a socket accepted from this listening socket some other way (i.e. by io_uring), it gets the
+		*	blocking type accept would have given it and the peer address is looked up when asked for
+		*/
+		TCPSocketInterface* adoptAccepted(SOCKET s);
+		/**
 		* @date  11/6/2003 1:19:26 PM
 		* @return  bool 
 		* @param  SOCKET_STATE s
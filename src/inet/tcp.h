@@ -6,6 +6,7 @@
 #include "socket_typedefs.h"
 #include "../error_type.h"
 #include <memory>
+#include <vector>
 
 namespace wss {
 
@@ -38,6 +39,19 @@ public:
 	*/
 	bool isNonBlocking() {return getImpl()->isNonBlocking();}
 	/**
+	* @return  bool 
+	*  
+	*  true if TCP_NODELAY is known to be set, either by setNagelOff or inherited from a listener
+	*/
+	bool isNagelOff() {return getImpl()->isNagelOff();}
+	/**
+	* @return  ErrorType 
+	* @param  const SocketOptions &opts
+	*  
+	*  sets every option in opts
+	*/
+	ErrorType applyOptions(const SocketOptions &opts) {return getImpl()->applyOptions(opts);}
+	/**
 	* @date  11/6/2003 3:11:50 PM
 	* @return  ErrorType 
 	*  
@@ -94,6 +108,13 @@ public:
 	*/
 	ErrorType setReuseAddress(const bool &opt) {return getImpl()->setReuseAddress(opt);}
 	/**
+	* @return  ErrorType 
+	* @param  const bool &opt
+	*  
+	*  SO_REUSEPORT, several listeners (i.e. one per thread) bound to the same address and port
+	*/
+	ErrorType setReusePort(const bool &opt) {return getImpl()->setReusePort(opt);}
+	/**
 	* @date  11/6/2003 1:11:03 PM
 	* @return  ErrorType 
 	*  
@@ -143,6 +164,20 @@ public:
 	*/
 	uint32_t bytesToRead() {return getImpl()->bytesToRead();}
 	/**
+	* @return  ErrorType
+	* @param  InetAddressV4 &addr
+	* @param  PortNum &port
+	*  
+	*  address and port the socket is bound to, i.e. the port picked for a listen on port 0
+	*/
+	ErrorType getLocalAddress(InetAddressV4 &addr, PortNum &port) {return getImpl()->getLocalAddrAndPort(addr,port);}
+	/**
+	* @return  BaseSocketInterface::SOCKET
+	*  
+	*  the OS socket, for registering with an event loop
+	*/
+	BaseSocketInterface::SOCKET getNativeHandle() const {return getImpl()->getNativeHandle();}
+	/**
 	* @date  2/1/2004 5:01:40 PM
 	* @return  void 
 	*  
@@ -250,6 +285,27 @@ public:
 	int receive(char *data, uint32_t size) {
 		return getImpl()->receive(data,size);
 	}
+	/**
+	* @return  int 
+	* @param  const ConstBufferSpan *spans
+	* @param  uint32_t count
+	*  
+	*  gather send (writev) of up to MAX_IOVEC spans, return values are the same as send
+	*/
+	int sendv(const ConstBufferSpan *spans, uint32_t count) {
+		return getImpl()->sendv(spans,count);
+	}
+	/**
+	* @return  int 
+	* @param  const BufferSpan *spans
+	* @param  uint32_t count
+	*  
+	*  scatter receive (readv) into up to MAX_IOVEC spans, return values are the same as receive
+	*	but the data is not null terminated and an orderly shutdown leaves the socket open to send
+	*/
+	int receivev(const BufferSpan *spans, uint32_t count) {
+		return getImpl()->receivev(spans,count);
+	}
 protected:
 	TCPServerSocket(TCPSocketInterface *os) 
 		: BaseSocket<TCPSocketInterface>(std::shared_ptr<TCPSocketInterface>(os)) {}
@@ -323,6 +379,33 @@ public:
 	*
 	*/
 	ErrorType connect(const InetAddressV4 &addr, short nPort, uint32_t waitTimeMS);
+	/**
+	* @return  ErrorType 
+	* @param  const InetAddressV4 &addr
+	* @param  short nPort
+	*  
+	*  start a connect without waiting for it (see TCPSocketInterface::beginConnect), the socket
+	*	should be non blocking.  ASyncServer::connect does the waiting for many at once
+	*/
+	ErrorType beginConnect(const InetAddressV4 &addr, short nPort) {
+		return getImpl()->beginConnect(addr,nPort);
+	}
+	/**
+	* @return  ErrorType 
+	*  
+	*  outcome of beginConnect once the socket is writable
+	*/
+	ErrorType finishConnect() {
+		return getImpl()->finishConnect();
+	}
+	/**
+	* @return  bool 
+	*  
+	*  true once a connect has completed
+	*/
+	bool isConnected() const {
+		return getImpl()->isConnected();
+	}
 };
 
 /**
@@ -330,7 +413,7 @@ public:
 */
 class ListenerSocket : public BaseSocket<TCPSocketInterface> {
 public:
-	enum {DEFAULT_BACKLOG = 5};
+	enum {DEFAULT_BACKLOG = SOMAXCONN};
 public:
 	/**
 	* @date  1/13/2005 2:14:35 PM
@@ -349,6 +432,16 @@ public:
 	ListenerSocket(const ListenerSocket &ls) : BaseSocket<TCPSocketInterface>(ls) {
 	}
 	/**
+	* @return  ListenerSocket &
+	* @param  const ListenerSocket &ls
+	*  
+	*  shares ls's socket, same as the copy ctor
+	*/
+	ListenerSocket &operator=(const ListenerSocket &ls) {
+		getImpl() = ls.getImpl();
+		return *this;
+	}
+	/**
 	* @date  1/13/2005 2:14:39 PM
 	* @return  ErrorType 
 	* @param  const PortNum &port
@@ -433,6 +526,50 @@ public:
 		}
 		return et;
 	}
+	/**
+	* @return  ErrorType 
+	* @param  std::vector<TCPSocketType*> &outGoing
+	* @param  size_t max
+	*  
+	*  accepts up to max waiting connections, appending them to outGoing.  Stops once the backlog is empty, a
+	*	blocking listener stops after one so it never waits for a second.  Connections aborted while in the
+	*	backlog are skipped, running out of descriptors (EMFILE, ENFILE) or memory returns the error with the
+	*	listener left open and the rest of the backlog waiting
+	*/
+	template<typename TCPSocketType>
+	ErrorType getNewConnections(std::vector<TCPSocketType*> &outGoing, size_t max) {
+		ErrorType et;
+		for(size_t i=0;i<max;++i) {
+			TCPSocketType *sock = 0;
+			et = getNewConnection(sock);
+			if(!et || !sock) {
+				break;
+			}
+			outGoing.push_back(sock);
+			if(!getImpl()->isNonBlocking()) {
+				break;
+			}
+		}
+		return et;
+	}
+	/**
+	* @return  ErrorType 
+	* @param  const SocketOptions &opts
+	*  
+	*  set opts on the listener, connections accepted after this start out with them (and already non
+	*	blocking if the listener is) so TCPComChannel has nothing left to set on them
+	*/
+	ErrorType setAcceptOptions(const SocketOptions &opts) {return getImpl()->setAcceptOptions(opts);}
+	/**
+	* @return  TCPSocketType *
+	* @param  BaseSocketInterface::SOCKET s
+	*  
+	*  wrap a connection accepted from this listener without getNewConnection (i.e. by io_uring)
+	*/
+	template<typename TCPSocketType>
+	TCPSocketType *adoptConnection(BaseSocketInterface::SOCKET s) {
+		return new TCPSocketType(getImpl()->adoptAccepted(s));
+	}
 	virtual ~ListenerSocket();
 };
 }
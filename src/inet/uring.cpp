@@ -0,0 +1,198 @@
+#include "uring.h"
+
+#ifdef WSS_HAS_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+using namespace wss;
+
+//the kernel reads the tails and writes the heads (and the reverse for the completion ring) concurrently with us
+template<typename T>
+static inline T loadAcquire(const T *p) {return __atomic_load_n(p,__ATOMIC_ACQUIRE);}
+template<typename T>
+static inline void storeRelease(T *p, T v) {__atomic_store_n(p,v,__ATOMIC_RELEASE);}
+
+URing::URing() : mFD(-1), mRing(MAP_FAILED), mRingSize(0), mSQEs(static_cast<io_uring_sqe*>(MAP_FAILED)), mSQEsSize(0)
+	, mSQHead(0), mSQTail(0), mSQMask(0), mSQEntries(0), mSQLocalTail(0), mCQHead(0), mCQTail(0), mCQMask(0), mCQEs(0)
+	, mBufRing(static_cast<io_uring_buf_ring*>(MAP_FAILED)), mBufRingSize(0), mBufMask(0), mBufTail(0), mBufPending(0) {
+}
+
+URing::~URing() {
+	if(mFD>=0) {
+		::close(mFD);
+	}
+	if(mBufRing!=MAP_FAILED) {
+		::munmap(mBufRing,mBufRingSize);
+	}
+	if(mSQEs!=MAP_FAILED) {
+		::munmap(mSQEs,mSQEsSize);
+	}
+	if(mRing!=MAP_FAILED) {
+		::munmap(mRing,mRingSize);
+	}
+}
+
+/**********************************************************************************************
+* URing::init -- io_uring_setup and map the rings
+*
+* In: entries - submission ring size, rounded up to a power of 2 by the kernel
+*
+*********************************************************************************************/
+ErrorType URing::init(uint32_t entries) {
+	if(mFD>=0) {
+		return ErrorType();
+	}
+	io_uring_params params;
+	memset(&params,0,sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = entries*4;
+	int fd = (int)syscall(__NR_io_uring_setup,entries,&params);
+	if(fd<0) {
+		return ErrorType(ErrorType::codeOSSpecific,errno);
+	}
+	mFD = fd;
+	//EXT_ARG for a wait timeout without a timeout request, SINGLE_MMAP and NODROP to keep this simple
+	const uint32_t needed = IORING_FEAT_EXT_ARG | IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP;
+	if((params.features & needed)!=needed) {
+		return ErrorType(ErrorType::codeOSSpecific,EOPNOTSUPP);
+	}
+	mRingSize = (std::max)(size_t(params.sq_off.array + params.sq_entries*sizeof(unsigned)),
+		size_t(params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe)));
+	mRing = ::mmap(0,mRingSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,mFD,IORING_OFF_SQ_RING);
+	if(mRing==MAP_FAILED) {
+		return ErrorType(ErrorType::codeOSSpecific,errno);
+	}
+	mSQEsSize = params.sq_entries*sizeof(io_uring_sqe);
+	mSQEs = static_cast<io_uring_sqe*>(::mmap(0,mSQEsSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,mFD,IORING_OFF_SQES));
+	if(mSQEs==MAP_FAILED) {
+		return ErrorType(ErrorType::codeOSSpecific,errno);
+	}
+	uint8_t *ring = static_cast<uint8_t*>(mRing);
+	mSQHead = reinterpret_cast<unsigned*>(ring+params.sq_off.head);
+	mSQTail = reinterpret_cast<unsigned*>(ring+params.sq_off.tail);
+	mSQMask = *reinterpret_cast<unsigned*>(ring+params.sq_off.ring_mask);
+	mSQEntries = params.sq_entries;
+	mSQLocalTail = *mSQTail;
+	//entries are always used in ring order so the index array never changes
+	unsigned *sqArray = reinterpret_cast<unsigned*>(ring+params.sq_off.array);
+	for(unsigned i=0;i<mSQEntries;++i) {
+		sqArray[i] = i;
+	}
+	mCQHead = reinterpret_cast<unsigned*>(ring+params.cq_off.head);
+	mCQTail = reinterpret_cast<unsigned*>(ring+params.cq_off.tail);
+	mCQMask = *reinterpret_cast<unsigned*>(ring+params.cq_off.ring_mask);
+	mCQEs = reinterpret_cast<io_uring_cqe*>(ring+params.cq_off.cqes);
+	return ErrorType();
+}
+
+io_uring_sqe *URing::getSQE() {
+	if(mSQLocalTail-loadAcquire(mSQHead)>=mSQEntries) {
+		return 0;
+	}
+	io_uring_sqe *sqe = &mSQEs[mSQLocalTail & mSQMask];
+	++mSQLocalTail;
+	memset(sqe,0,sizeof(*sqe));
+	return sqe;
+}
+
+int URing::submit() {
+	storeRelease(mSQTail,mSQLocalTail);
+	unsigned pending = mSQLocalTail-loadAcquire(mSQHead);
+	if(pending==0) {
+		return 0;
+	}
+	int ret = (int)syscall(__NR_io_uring_enter,mFD,pending,0,0,(void*)0,(size_t)0);
+	return ret<0 ? -errno : ret;
+}
+
+/**********************************************************************************************
+* URing::submitAndWait -- one io_uring_enter for everything queued and the wait
+*
+*********************************************************************************************/
+int URing::submitAndWait(int waitTimeMS) {
+	storeRelease(mSQTail,mSQLocalTail);
+	unsigned pending = mSQLocalTail-loadAcquire(mSQHead);
+	__kernel_timespec ts;
+	io_uring_getevents_arg arg;
+	memset(&arg,0,sizeof(arg));
+	if(waitTimeMS>=0) {
+		ts.tv_sec = waitTimeMS/1000;
+		ts.tv_nsec = (waitTimeMS%1000)*1000000LL;
+		arg.ts = reinterpret_cast<uint64_t>(&ts);
+	}
+	int ret = (int)syscall(__NR_io_uring_enter,mFD,pending,1,IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,&arg,sizeof(arg));
+	if(ret<0) {
+		//timed out, interrupted, or completions backed up and need reaping first
+		if(errno==ETIME || errno==EINTR || errno==EBUSY || errno==EAGAIN) {
+			return 0;
+		}
+		return -errno;
+	}
+	return 0;
+}
+
+io_uring_cqe *URing::peekCQE() {
+	unsigned head = *mCQHead;
+	if(head==loadAcquire(mCQTail)) {
+		return 0;
+	}
+	return &mCQEs[head & mCQMask];
+}
+
+void URing::seenCQE() {
+	storeRelease(mCQHead,*mCQHead+1);
+}
+
+/**********************************************************************************************
+* URing::initBufferRing -- map and register a provided buffer ring (IORING_REGISTER_PBUF_RING)
+*
+*********************************************************************************************/
+ErrorType URing::initBufferRing(uint16_t group, uint32_t entries) {
+	if(mFD<0 || mBufRing!=MAP_FAILED || entries==0 || entries>32768 || (entries & (entries-1))!=0) {
+		return ErrorType(ErrorType::codeOSSpecific,EINVAL);
+	}
+	mBufRingSize = entries*sizeof(io_uring_buf);
+	mBufRing = static_cast<io_uring_buf_ring*>(::mmap(0,mBufRingSize,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0));
+	if(mBufRing==MAP_FAILED) {
+		return ErrorType(ErrorType::codeOSSpecific,errno);
+	}
+	io_uring_buf_reg reg;
+	memset(&reg,0,sizeof(reg));
+	reg.ring_addr = reinterpret_cast<uint64_t>(mBufRing);
+	reg.ring_entries = entries;
+	reg.bgid = group;
+	if(syscall(__NR_io_uring_register,mFD,IORING_REGISTER_PBUF_RING,&reg,1)<0) {
+		int e = errno;
+		::munmap(mBufRing,mBufRingSize);
+		mBufRing = static_cast<io_uring_buf_ring*>(MAP_FAILED);
+		return ErrorType(ErrorType::codeOSSpecific,e);
+	}
+	mBufMask = uint16_t(entries-1);
+	mBufTail = 0;
+	mBufPending = 0;
+	return ErrorType();
+}
+
+void URing::provideBuffer(void *addr, uint32_t len, uint16_t id) {
+	//entries start at the ring itself (the tail overlays the first one's reserved field), the header's flex array
+	//member is not at offset 0 when compiled as C++
+	io_uring_buf &buf = reinterpret_cast<io_uring_buf*>(mBufRing)[(mBufTail+mBufPending) & mBufMask];
+	buf.addr = reinterpret_cast<uint64_t>(addr);
+	buf.len = len;
+	buf.bid = id;
+	++mBufPending;
+}
+
+void URing::publishBuffers() {
+	if(mBufPending) {
+		mBufTail = uint16_t(mBufTail+mBufPending);
+		mBufPending = 0;
+		storeRelease(&mBufRing->tail,mBufTail);
+	}
+}
+
+#endif
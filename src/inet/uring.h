@@ -0,0 +1,96 @@
+#ifndef WSS_URING_H
+#define WSS_URING_H
+
+#include "../portable_types.h"
+#include "../error_type.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+//multishot accept and provided buffer rings (linux 5.19) are the newest pieces used
+#if defined(IORING_ACCEPT_MULTISHOT) && defined(IORING_FEAT_EXT_ARG)
+#define WSS_HAS_URING 1
+#endif
+
+namespace wss {
+
+#ifdef WSS_HAS_URING
+/*
+*	Thin io_uring:  the submission and completion rings mapped straight from the kernel (no liburing) and one
+*	provided buffer ring the kernel picks receive buffers from
+*
+*	Rules:
+*		1.	getSQE hands out the next free submission entry zeroed, nothing reaches the kernel until submit or
+*			submitAndWait so everything queued between them goes in with one system call
+*		2.	peekCQE / seenCQE walk the completions in order, a completion must be seen before the next is peeked
+*		3.	buffers are provided as (addr, len, id), the kernel only sees them after publishBuffers.  A buffer the
+*			kernel filled comes back by id in the completion flags and is ours until it is provided again
+*
+*	Not thread safe, one thread owns a ring.  Linux only
+*/
+class URing {
+public:
+	URing();
+	/*
+	*	unmaps the rings and closes the ring, anything still in flight is cancelled by the kernel
+	*/
+	~URing();
+	/*
+	*	set up a ring with entries submission slots (completion ring 4x that).  Fails if the kernel has no io_uring
+	*	(ENOSYS), it is turned off (EPERM) or it is too old for the features used (EOPNOTSUPP)
+	*/
+	ErrorType init(uint32_t entries);
+	/*
+	*	next submission entry or 0 if the submission ring is full (submit and try again)
+	*/
+	io_uring_sqe *getSQE();
+	/*
+	*	hand the queued entries to the kernel without waiting, returns the number taken or -errno
+	*/
+	int submit();
+	/*
+	*	hand the queued entries to the kernel and wait up to waitTimeMS (-1 forever) for a completion, a timeout
+	*	or signal is not an error.  Returns 0 or -errno
+	*/
+	int submitAndWait(int waitTimeMS);
+	/*
+	*	oldest completion not yet seen, 0 if there are none
+	*/
+	io_uring_cqe *peekCQE();
+	void seenCQE();
+	/*
+	*	register a ring of entries (a power of 2) provided buffers as group
+	*/
+	ErrorType initBufferRing(uint16_t group, uint32_t entries);
+	void provideBuffer(void *addr, uint32_t len, uint16_t id);
+	void publishBuffers();
+private:
+	int				mFD;
+	void			*mRing;
+	size_t			mRingSize;
+	io_uring_sqe	*mSQEs;
+	size_t			mSQEsSize;
+	unsigned		*mSQHead;
+	unsigned		*mSQTail;
+	unsigned		mSQMask;
+	unsigned		mSQEntries;
+	unsigned		mSQLocalTail;	//entries handed out, the kernel sees them when the tail is published
+	unsigned		*mCQHead;
+	unsigned		*mCQTail;
+	unsigned		mCQMask;
+	io_uring_cqe	*mCQEs;
+	io_uring_buf_ring	*mBufRing;
+	size_t			mBufRingSize;
+	uint16_t		mBufMask;
+	uint16_t		mBufTail;
+	uint16_t		mBufPending;	//provided but not published
+private:
+	SET_NO_COPY(URing);
+};
+#endif
+
+}
+#endif
@@ -2,21 +2,40 @@
 #define WSS_IREADERWRITER_H
 
 #include "io_typedefs.h"
+#include "../buffer/buffer_span.h"
+#include "../buffer/shared_buffer.h"
 #include <memory>
+#include <cstring>
 
 namespace wss {
+	class ReaderWriter;
+
 	class IReaderWriter {
 	public:
+		IReaderWriter() : Generation(0), WindowOwner(0), EagerCommit(false) { }
 		virtual ~IReaderWriter() { }
 	protected:
 		static const size_t DEFAULT_BLOCK_SIZE = 4000;
 		friend class ReaderWriter;
 
+		//bumped by ReaderWriter on anything that can move or change stored bytes, a pointer cached
+		//from raw() or prepare() is only good while the generation it was taken in is current
+		uint64_t Generation;
+		//ReaderWriter holding bytes written into its cached prepare() window that are not committed yet
+		ReaderWriter *WindowOwner;
+		//set by implementations whose commit publishes bytes to another thread, ReaderWriter then commits each
+		//fixed width write as it is made instead of leaving it in the window
+		bool EagerCommit;
+
 
 		virtual size_t read(size_t pos, void * dst, size_t length) = 0;
 		virtual size_t readUntilDelim(size_t pos, void * dst, size_t length, char delim, bool &wasDelimHit)=0;
 		virtual size_t write(size_t pos, const void * src, size_t length) = 0;
 		virtual size_t erase(size_t pos, size_t length) = 0;
+		//erase from the front of the stream, implementations should override if they can do better than erase(0,length)
+		virtual size_t consume(size_t length) {
+			return erase(0,length);
+		}
 
 		virtual size_t size() const = 0;
 		virtual size_t capacity() const = 0;
@@ -27,6 +46,93 @@ namespace wss {
 
 		//Get raw pointer to data
 		virtual const void * raw(size_t idx, size_t& out_length) const = 0;
+		//Find the first delim at or after pos without copying, scans whatever raw hands back
+		virtual bool findDelim(size_t pos, char delim, size_t &delimPos) const {
+			size_t len = 0;
+			const void *p = 0;
+			while((p = raw(pos,len))!=0 && len>0) {
+				const void *hit = memchr(p,delim,len);
+				if(hit) {
+					delimPos = pos+(static_cast<const uint8_t*>(hit)-static_cast<const uint8_t*>(p));
+					return true;
+				}
+				pos+=len;
+			}
+			return false;
+		}
+		//Independent copy of the stream, null if the implementation can't make one cheaply (the caller copies).
+		//Implementations that can share their memory copy on write should override
+		virtual IReaderWriter *snapshot() const {
+			return 0;
+		}
+		//Give back memory the stream holds beyond what its data needs, nothing to do by default
+		virtual void shrinkToFit() {
+		}
+		//Get writable memory at the end of the stream, null if the implementation can't hand out its memory
+		virtual void * prepare(size_t /*length*/, size_t& out_length) {
+			out_length = 0;
+			return 0;
+		}
+		//Mark length bytes handed out by prepare as written, returns bytes committed
+		virtual size_t commit(size_t /*length*/) {
+			return 0;
+		}
+		//Insert length bytes in front of the stream, returns bytes prepended, 0 if the implementation can't
+		virtual size_t prepend(const void * /*src*/, size_t /*length*/) {
+			return 0;
+		}
+		//Keep bytes free in front of the data for prepend to use, nothing to do by default
+		virtual void reserveHeadroom(uint32_t /*bytes*/) {
+		}
+		//Append a shared payload to the end of the stream, implementations that can hold a ref on the payload
+		//rather than copy it should override
+		virtual size_t appendShared(const SharedBuffer &sb) {
+			size_t written = 0;
+			for(size_t i=0;i<sb.getSegmentCount();i++) {
+				const SharedBuffer::Segment &seg = sb.getSegment(i);
+				size_t w = write(size(),seg.Data,seg.Length);
+				written+=w;
+				if(w!=seg.Length) {
+					break;
+				}
+			}
+			return written;
+		}
+		//Move length bytes at pos to the end of dst and erase them here, returns bytes moved (less if dst fills up).
+		//The default copies through raw(), implementations that can hand their memory to dst should override
+		virtual size_t splice(IReaderWriter &dst, size_t pos, size_t length) {
+			size_t moved = 0;
+			while(moved<length) {
+				size_t len = 0;
+				const void *p = raw(pos+moved,len);
+				if(!p || len==0) {
+					break;
+				}
+				len = len>length-moved ? length-moved : len;
+				size_t w = dst.write(dst.size(),p,len);
+				moved+=w;
+				if(w!=len) {
+					break;
+				}
+			}
+			return erase(pos,moved);
+		}
+		//Get up to maxSpans raw pointers covering length bytes from idx, returns the number of spans filled
+		virtual size_t rawSpans(size_t idx, size_t length, ConstBufferSpan *spans, size_t maxSpans) const {
+			size_t count = 0;
+			while(length>0 && count<maxSpans) {
+				size_t len = 0;
+				const void *p = raw(idx,len);
+				if(!p || len==0) {
+					break;
+				}
+				len = len>length ? length : len;
+				spans[count++] = ConstBufferSpan(p,len);
+				idx+=len;
+				length-=len;
+			}
+			return count;
+		}
 	};
 }
 
@@ -1,7 +1,16 @@
 #include "readerwriter.h"
 #include <algorithm>
+#include <cstring>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #include "../buffer/segmented_reader_writer_impl.h"
+#include "../buffer/ring_reader_writer_impl.h"
+#include "../buffer/mapped_reader_writer_impl.h"
+#include "../buffer/spsc_reader_writer_impl.h"
 
 using namespace wss;
 
@@ -11,11 +20,32 @@ IReaderWriter * ReaderWriter::Create_Default_Interface()
 	return SegmentedReaderWriterImpl::Create();
 }
 
+IReaderWriter * ReaderWriter::Create_Default_Interface(const BlockSizePolicy &policy)
+{
+	return SegmentedReaderWriterImpl::Create(policy);
+}
+
+IReaderWriter * ReaderWriter::Create_Ring_Interface(size_t capacity)
+{
+	return RingReaderWriterImpl::Create(capacity);
+}
+
+IReaderWriter * ReaderWriter::Create_Mapped_Interface(const char *fileName, bool writable, ErrorType &et)
+{
+	return MappedReaderWriterImpl::Create(fileName, writable ? MappedReaderWriterImpl::READ_WRITE : MappedReaderWriterImpl::READ_ONLY, et);
+}
+
+void ReaderWriter::Create_SPSC_Interfaces(IReaderWriter *&producer, IReaderWriter *&consumer, size_t maxQueued)
+{
+	SPSCQueue::Create(producer, consumer, maxQueued);
+}
+
 ReaderWriter::ReaderWriter( IReaderWriter* stream_interface ) :
 ReadCursor(0)
 ,WriteCursor(0) 
 ,Impl(stream_interface) 
 {
+	resetWindows();
 	WriteCursor = stream_interface->size();
 }
 
@@ -24,11 +54,119 @@ ReadCursor(0)
 ,WriteCursor(0) 
 ,Impl(other.Impl) 
 {
+	resetWindows();
+	syncWindows();
 	WriteCursor = Impl->size();
 }
 
+ReaderWriter &ReaderWriter::operator=( const ReaderWriter& other ) {
+	if(this != &other) {
+		syncWindows();
+		Impl = other.Impl;
+		syncWindows();
+		ReadCursor = other.ReadCursor;
+		WriteCursor = other.WriteCursor;
+		resetWindows();
+	}
+	return *this;
+}
+
 ReaderWriter::~ReaderWriter() {
+	if(Impl && Impl->WindowOwner == this) {
+		commitWriteWindow();
+	}
+}
+
+void ReaderWriter::resetWindows() {
+	ReadWindow = 0;
+	ReadWindowPos = 0;
+	ReadWindowLength = 0;
+	ReadWindowGeneration = 0;
+	WriteWindow = 0;
+	WriteWindowEnd = 0;
+	WriteWindowPos = 0;
+	WriteWindowPending = 0;
+	WriteWindowGeneration = 0;
+}
+
+/**********************************************************************************************
+* ReaderWriter::SyncWindows -- Commit bytes left in a write window
+*
+*	Fixed width writes only bump a pointer into memory from prepare(), the commit waits until
+*	something else looks at or changes the stream.  Every method that calls into Impl calls
+*	this first, whichever ReaderWriter on the stream did the writing.
+*
+*********************************************************************************************/
+void ReaderWriter::syncWindows() const {
+	ReaderWriter *owner = Impl->WindowOwner;
+	if(owner) {
+		owner->commitWriteWindow();
+	}
+}
 
+void ReaderWriter::commitWriteWindow() const {
+	if(WriteWindowPending > 0) {
+		Impl->commit(WriteWindowPending);
+		WriteWindowPending = 0;
+	}
+	Impl->WindowOwner = 0;
+}
+
+/**********************************************************************************************
+* ReaderWriter::ReadFixedSlow -- Refill the read window then read a fixed width value
+*
+*	The window is whatever contiguous span raw() has at the read cursor, a value that straddles
+*	the end of it (or of the stream) goes through read.
+*
+*********************************************************************************************/
+size_t ReaderWriter::readFixedSlow( void * dst, size_t length ) {
+	syncWindows();
+	if(ReadCursor < Impl->size()) {
+		size_t len = 0;
+		const void *p = Impl->raw(ReadCursor, len);
+		if(p && len > 0) {
+			ReadWindow = static_cast<const uint8_t*>(p);
+			ReadWindowPos = ReadCursor;
+			ReadWindowLength = (std::min)(len, Impl->size() - ReadCursor);
+			ReadWindowGeneration = Impl->Generation;
+			if(length <= ReadWindowLength) {
+				memcpy(dst, ReadWindow, length);
+				ReadCursor += length;
+				return length;
+			}
+		}
+	}
+	return read(dst, length);
+}
+
+/**********************************************************************************************
+* ReaderWriter::WriteFixedSlow -- Get a new write window then write a fixed width value
+*
+*	Only appends get a window, an overwrite in the middle of the stream (or a stream that can't
+*	hand out its memory) goes through write.  A fixed capacity stream without room for the whole
+*	value is left alone and 0 is returned, half a value would corrupt whatever is framed after it.
+*
+*********************************************************************************************/
+size_t ReaderWriter::writeFixedSlow( const void * src, size_t length ) {
+	syncWindows();
+	if(Impl->fixedCapacity() && (WriteCursor > Impl->capacity() || Impl->capacity() - WriteCursor < length)) {
+		return 0;
+	}
+	if(length > 0 && WriteCursor == Impl->size()) {
+		size_t avail = 0;
+		uint8_t *p = static_cast<uint8_t*>(Impl->prepare(length, avail));
+		++Impl->Generation;
+		if(p && avail > 0) {
+			WriteWindow = p;
+			WriteWindowEnd = p + avail;
+			WriteWindowPos = WriteCursor;
+			WriteWindowGeneration = Impl->Generation;
+			if(length <= avail) {
+				return writeFixed(src, length);
+			}
+		}
+	}
+	return write(src, length);
 }
 
 /**********************************************************************************************
@@ -43,6 +181,7 @@ ReaderWriter::~ReaderWriter() {
 size_t ReaderWriter::read( void * dst, size_t length ) {
 	//Adjust length here.  Never pass length to Impl that would read more than is available
 	if(length > 0) {
+		syncWindows();
 		size_t real_len = length;
 		if(real_len + ReadCursor > Impl->size()) {
 			real_len = Impl->size() - ReadCursor;
@@ -58,6 +197,7 @@ size_t ReaderWriter::read( void * dst, size_t length ) {
 size_t ReaderWriter::readUntilDelim(void * dst, size_t length, char delim, bool &wasDelimHit) {
 	//Adjust length here.  Never pass length to Impl that would read more than is available
 	if(length > 0) {
+		syncWindows();
 		size_t real_len = length;
 		if(real_len + ReadCursor > Impl->size()) {
 			real_len = Impl->size() - ReadCursor;
@@ -69,6 +209,25 @@ size_t ReaderWriter::readUntilDelim(void * dst, size_t length, char delim, bool
 	}
 	return STREAM_ERROR; //error
 }
+/**********************************************************************************************
+* ReaderWriter::FindDelim -- Find a delimiter without reading
+*
+* In: pos - Index to start searching at (i.e. tellRead())
+*		delim - byte to search for
+*
+* Returns: Index of the delimiter or STREAM_ERROR if it is not in the stream.  The read
+*		cursor is not moved, so a framer can check for a whole line before reading it.
+*
+*********************************************************************************************/
+size_t ReaderWriter::findDelim( size_t pos, char delim ) const {
+	size_t delimPos = 0;
+	syncWindows();
+	if(pos < Impl->size() && Impl->findDelim(pos, delim, delimPos)) {
+		return delimPos;
+	}
+	return STREAM_ERROR;
+}
+
 /**********************************************************************************************
 * ReaderWriter::Write -- Write data to the stream
 *
@@ -82,18 +241,22 @@ size_t ReaderWriter::write( const void * src, size_t length ) {
 
 	if(length > 0)
 	{
+		syncWindows();
 		//If fixed size then adjust length of data if needed.
+		//capacity is read once, a bounded SPSC producer's grows as the consumer catches up
 		size_t real_length = length;
-		if(real_length + WriteCursor > Impl->capacity())
+		size_t cap = Impl->capacity();
+		if(real_length + WriteCursor > cap)
 		{
 			if(Impl->fixedCapacity())
 			{
 				//Can't resize the buffer
-				real_length = (Impl->capacity() - WriteCursor);
+				real_length = (cap - WriteCursor);
 			}
 		}
 
 		size_t written = Impl->write(WriteCursor, src, real_length);
+		++Impl->Generation;
 		WriteCursor += written;
 		return written;
 	}
@@ -101,6 +264,107 @@ size_t ReaderWriter::write( const void * src, size_t length ) {
 }
 
 
+/**********************************************************************************************
+* ReaderWriter::Prepare -- Get writable memory at the end of the stream
+*
+* In: length - Number of bytes the caller would like to write, this is a hint the
+*		implementation may hand back more or less
+*
+* Out: out_length - Number of contiguous bytes that can be written to the returned pointer
+*
+* Returns: pointer to write to or null if the stream can't hand out its memory or the write
+*		cursor is not at the end of the stream.  Nothing is written until commit is called.
+* 
+*********************************************************************************************/
+void * ReaderWriter::prepare( size_t length, size_t& out_length ) {
+	out_length = 0;
+	syncWindows();
+	if(length > 0 && WriteCursor == Impl->size()) {
+		//a growing mapping can move, and a segmented tail can be sealed
+		++Impl->Generation;
+		return Impl->prepare(length, out_length);
+	}
+	return 0;
+}
+
+/**********************************************************************************************
+* ReaderWriter::Commit -- Mark bytes written into memory from prepare as part of the stream
+*
+* In: length - Number of bytes written, must not be more than prepare's out_length
+*
+* Returns: The number of bytes actually committed.
+* 
+*********************************************************************************************/
+size_t ReaderWriter::commit( size_t length ) {
+	syncWindows();
+	size_t committed = Impl->commit(length);
+	WriteCursor += committed;
+	return committed;
+}
+
+/**********************************************************************************************
+* ReaderWriter::Prepend -- Insert bytes in front of the stream
+*
+* In: src - Bytes to insert
+*		length - Number of bytes to insert
+*
+* Returns: Number of bytes inserted, 0 if the stream can't prepend.  Every index moves up by
+*		that much, so a read cursor at 0 reads the new bytes next.
+* 
+*********************************************************************************************/
+size_t ReaderWriter::prepend( const void * src, size_t length ) {
+	if(length == 0) {
+		return 0;
+	}
+	syncWindows();
+	++Impl->Generation;
+	size_t prepended = Impl->prepend(src, length);
+	if(ReadCursor > 0) {
+		ReadCursor += prepended;
+	}
+	WriteCursor += prepended;
+	return prepended;
+}
+
+void ReaderWriter::reserveHeadroom( uint32_t bytes ) {
+	syncWindows();
+	//an empty head block may move its start
+	++Impl->Generation;
+	Impl->reserveHeadroom(bytes);
+}
+
+/**********************************************************************************************
+* ReaderWriter::WriteShared -- Write a shared payload at the write cursor
+*
+* In: sb - payload to write, the stream may keep a ref on its blocks rather than copy them
+*
+* Returns: Number of bytes written, less than sb.size() if a fixed capacity stream filled up.
+*		If the write cursor is not at the end of the stream the payload is copied in like write.
+* 
+*********************************************************************************************/
+size_t ReaderWriter::writeShared( const SharedBuffer &sb ) {
+	size_t written = 0;
+	syncWindows();
+	if(WriteCursor == Impl->size()) {
+		++Impl->Generation;
+		written = Impl->appendShared(sb);
+		WriteCursor += written;
+	} else {
+		for(size_t i=0;i<sb.getSegmentCount();i++) {
+			const SharedBuffer::Segment &seg = sb.getSegment(i);
+			size_t w = write(seg.Data, seg.Length);
+			if(w == STREAM_ERROR) {
+				continue;
+			}
+			written += w;
+			if(w != seg.Length) {
+				break;
+			}
+		}
+	}
+	return written;
+}
+
 /**********************************************************************************************
 * ReaderWriter::Erase -- Erase data from the stream
 * 
@@ -113,8 +377,100 @@ size_t ReaderWriter::write( const void * src, size_t length ) {
 size_t ReaderWriter::erase( size_t idx, size_t length ) {
 
 	//get actual amount erased
+	syncWindows();
+	++Impl->Generation;
 	size_t erased_length = Impl->erase(idx, length);
+	moveCursorsForErase(idx, erased_length);
+	return erased_length;
+}
+
+/**********************************************************************************************
+* ReaderWriter::Consume -- Erase data from the front of the stream
+* 
+* In: length - Number of bytes to erase
+*
+* Returns: Number of bytes actually erased.
+*
+*********************************************************************************************/
+size_t ReaderWriter::consume( size_t length ) {
+	syncWindows();
+	++Impl->Generation;
+	size_t erased_length = Impl->consume(length);
+	moveCursorsForErase(0, erased_length);
+	return erased_length;
+}
+
+/**********************************************************************************************
+* ReaderWriter::Splice -- Move bytes from this stream to the end of another
+*
+* In: dst - stream to append to, must not be this stream
+*		idx - index of the first byte to move
+*		length - Number of bytes to move
+*
+* Returns: Number of bytes moved, they are erased from this stream (cursors move as for erase).
+*		Less than length if there are fewer bytes or dst is bounded and filled up.
+*
+*********************************************************************************************/
+size_t ReaderWriter::splice( ReaderWriter &dst, size_t idx, size_t length ) {
+	if(Impl == dst.Impl || length == 0) {
+		return 0;
+	}
+	syncWindows();
+	dst.syncWindows();
+	bool dstAtEnd = dst.WriteCursor == dst.Impl->size();
+	++Impl->Generation;
+	++dst.Impl->Generation;
+	size_t moved = Impl->splice(*dst.Impl, idx, length);
+	moveCursorsForErase(idx, moved);
+	if(dstAtEnd) {
+		dst.WriteCursor += moved;
+	}
+	return moved;
+}
+
+/**********************************************************************************************
+* ReaderWriter::Snapshot -- Copy of the stream as it is now
+*
+*	Streams that can't snapshot themselves (ring, mapped) are copied into a default stream.
+*
+* Out: out - points at the copy, with this one's read and write cursors
+*
+*********************************************************************************************/
+void ReaderWriter::snapshot( ReaderWriter &out ) const {
+	syncWindows();
+	IReaderWriter *copy = Impl->snapshot();
+	if(copy) {
+		//our write window is in what is now a shared tail, get a fresh one
+		++Impl->Generation;
+	} else {
+		copy = Create_Default_Interface();
+		size_t pos = 0;
+		size_t len = 0;
+		const void *p = 0;
+		while(pos < Impl->size() && (p = Impl->raw(pos, len)) != 0 && len > 0) {
+			copy->write(pos, p, len);
+			pos += len;
+		}
+	}
+	ReaderWriter rw(copy);
+	rw.ReadCursor = ReadCursor;
+	rw.WriteCursor = WriteCursor;
+	out = rw;
+}
 
+/**********************************************************************************************
+* ReaderWriter::ShrinkToFit -- Release memory the stream doesn't need for its data
+*
+*	Cursors are unchanged, the data may be moved to new memory
+*
+*********************************************************************************************/
+void ReaderWriter::shrinkToFit() {
+	syncWindows();
+	++Impl->Generation;
+	Impl->shrinkToFit();
+}
+
+void ReaderWriter::moveCursorsForErase( size_t idx, size_t erased_length ) {
 	//Move read and write cursors
 	//If
 	//  Cursor is before erased data - Do nothing.
@@ -142,8 +498,6 @@ size_t ReaderWriter::erase( size_t idx, size_t length ) {
 	{
 		WriteCursor -= erased_length;
 	}
-
-	return erased_length;
 }
 
 /**********************************************************************************************
@@ -166,6 +520,7 @@ size_t ReaderWriter::tellRead() const {
 *********************************************************************************************/
 size_t ReaderWriter::seekRead( pos_type distance, StreamSeekType seek_type ) {
 	size_t new_cursor = 0;
+	syncWindows();
 	switch(seek_type)
 	{
 	case BEGIN:
@@ -214,6 +569,7 @@ size_t ReaderWriter::tellWrite() const {
 *********************************************************************************************/
 size_t ReaderWriter::seekWrite( pos_type distance, StreamSeekType seek_type ) {
 	size_t new_cursor = 0;
+	syncWindows();
 	switch(seek_type)
 	{
 	case BEGIN:
@@ -249,9 +605,27 @@ bool ReaderWriter::empty() const {
 * 
 *********************************************************************************************/
 size_t ReaderWriter::size() const {
+	syncWindows();
 	return Impl->size();
 }
 
+/**********************************************************************************************
+* ReaderWriter::Capacity -- Returns the number of bytes the stream can hold without growing
+* 
+*********************************************************************************************/
+size_t ReaderWriter::capacity() const {
+	syncWindows();
+	return Impl->capacity();
+}
+
+/**********************************************************************************************
+* ReaderWriter::FixedCapacity -- Returns true if the stream can never hold more than capacity()
+* 
+*********************************************************************************************/
+bool ReaderWriter::fixedCapacity() const {
+	return Impl->fixedCapacity();
+}
+
 
 /**********************************************************************************************
 * ReaderWriter::Raw -- Fetch a raw pointer to the data at a given index  
@@ -266,9 +640,27 @@ size_t ReaderWriter::size() const {
 *
 *********************************************************************************************/
 const void * ReaderWriter::raw( size_t idx, size_t& out_length ) const {
+	syncWindows();
 	return Impl->raw(idx, out_length);
 }
 
+/**********************************************************************************************
+* ReaderWriter::RawSpans -- Fetch raw pointers to a range of data without copying it
+*
+* In: idx - Index of the first byte requested
+*		length - number of bytes requested
+*		maxSpans - size of the spans array
+*
+* Out: spans - pointer/length pairs covering up to length bytes, suitable for writev
+*
+* Returns: number of spans filled in, fewer than length bytes are covered if maxSpans is hit
+*
+*********************************************************************************************/
+size_t ReaderWriter::rawSpans( size_t idx, size_t length, ConstBufferSpan *spans, size_t maxSpans ) const {
+	syncWindows();
+	return Impl->rawSpans(idx, length, spans, maxSpans);
+}
+
 
 /**********************************************************************************************
 * ReaderWriter::Get_Preferred_Block_Size -- returns preferred blocksize for this buffer
@@ -293,7 +685,8 @@ size_t ReaderWriter::readVarUInt32(uint32_t& val) {
 			return STREAM_ERROR;
 		}
 
-		if(readFixed8(b) == STREAM_ERROR) {
+		//a short read (end of stream) is an error too, b would be garbage
+		if(readFixed8(b) != sizeof(b)) {
 			return STREAM_ERROR;
 		}
 
@@ -335,7 +728,7 @@ size_t ReaderWriter::readVarUInt64(uint64_t& val) {
 			return STREAM_ERROR;
 		}
 
-		if(readFixed8(b) == STREAM_ERROR) {
+		if(readFixed8(b) != sizeof(b)) {
 			return STREAM_ERROR;
 		}
 
@@ -362,6 +755,186 @@ size_t ReaderWriter::readVarSInt64(int64_t& val) {
 	return ret;
 }
 
+/**********************************************************************************************
+*
+* ReaderWriter::readVarIntArray -- Bulk VarInt decode
+*
+*	Decodes straight out of the contiguous span raw() hands back for the read cursor, while a whole
+*	MaxVarInt64 is left in the span there are no per byte bounds checks or virtual calls.  Only a varint
+*	near the end of a span (it may straddle a block boundary) goes through readVarUInt32/64.
+*
+*********************************************************************************************/
+template<typename T>
+size_t ReaderWriter::readVarIntArray(T *vals, size_t count) {
+	const size_t maxBytes = sizeof(T) == sizeof(uint32_t) ? MaxVarInt32 : MaxVarInt64;
+	size_t done = 0;
+	syncWindows();
+	while(done < count && ReadCursor < Impl->size()) {
+		size_t len = 0;
+		const uint8_t *p = static_cast<const uint8_t*>(Impl->raw(ReadCursor, len));
+		if(!p || len == 0) {
+			break;
+		}
+		len = (std::min)(len, Impl->size() - ReadCursor);
+		size_t used = 0;
+		while(done < count && (len - used) >= MaxVarInt64) {
+			uint64_t n = 0;
+			size_t vlen = ReadVarInt64Helper(p + used, n, maxBytes);
+			if(vlen == 0) {
+				ReadCursor += used;
+				return done;
+			}
+			fromVarInt(n, vals[done++]);
+			used += vlen;
+		}
+		ReadCursor += used;
+		if(done < count) {
+			//end of the span, a byte at a time in case the varint runs into the next block
+			size_t start = ReadCursor;
+			uint64_t n = 0;
+			size_t vlen = 0;
+			if(maxBytes == MaxVarInt32) {
+				uint32_t n32 = 0;
+				vlen = readVarUInt32(n32);
+				n = n32;
+			} else {
+				vlen = readVarUInt64(n);
+			}
+			if(vlen == STREAM_ERROR) {
+				ReadCursor = start;
+				break;
+			}
+			fromVarInt(n, vals[done++]);
+		}
+	}
+	return done;
+}
+
+/**********************************************************************************************
+*
+* ReaderWriter::writeVarIntArray -- Bulk VarInt encode
+*
+*	Encodes straight into the memory prepare() hands out at the end of the stream.  If the stream can't
+*	hand out memory (or the write cursor isn't at the end) varints are staged and written in batches,
+*	only whole varints are written so a fixed capacity stream never ends with a partial one.
+*
+*********************************************************************************************/
+template<typename T>
+size_t ReaderWriter::writeVarIntArray(const T *vals, size_t count) {
+	size_t done = 0;
+	while(done < count) {
+		size_t avail = 0;
+		uint8_t *p = static_cast<uint8_t*>(prepare(MaxVarInt64, avail));
+		if(!p || avail < MaxVarInt64) {
+			break;
+		}
+		size_t used = 0;
+		while(done < count && (avail - used) >= MaxVarInt64) {
+			used += WriteVarInt64Helper(toVarInt(vals[done++]), p + used);
+		}
+		commit(used);
+	}
+	uint8_t buffer[512];
+	while(done < count) {
+		size_t room = sizeof(buffer);
+		if(Impl->fixedCapacity()) {
+			room = WriteCursor < Impl->capacity() ? (std::min)(room, Impl->capacity() - WriteCursor) : 0;
+		}
+		size_t used = 0;
+		size_t batch = done;
+		while(batch < count) {
+			uint8_t varInt[MaxVarInt64];
+			size_t vlen = WriteVarInt64Helper(toVarInt(vals[batch]), varInt);
+			if(used + vlen > room) {
+				break;
+			}
+			memcpy(buffer + used, varInt, vlen);
+			used += vlen;
+			++batch;
+		}
+		if(used == 0 || write(buffer, used) != used) {
+			break;
+		}
+		done = batch;
+	}
+	return done;
+}
+
+template size_t ReaderWriter::readVarIntArray<uint32_t>(uint32_t *vals, size_t count);
+template size_t ReaderWriter::readVarIntArray<int32_t>(int32_t *vals, size_t count);
+template size_t ReaderWriter::readVarIntArray<uint64_t>(uint64_t *vals, size_t count);
+template size_t ReaderWriter::readVarIntArray<int64_t>(int64_t *vals, size_t count);
+template size_t ReaderWriter::writeVarIntArray<uint32_t>(const uint32_t *vals, size_t count);
+template size_t ReaderWriter::writeVarIntArray<int32_t>(const int32_t *vals, size_t count);
+template size_t ReaderWriter::writeVarIntArray<uint64_t>(const uint64_t *vals, size_t count);
+template size_t ReaderWriter::writeVarIntArray<int64_t>(const int64_t *vals, size_t count);
+
+/**********************************************************************************************
+*
+* ReaderWriter::ReadVarInt64Helper -- Helper for decoding a VarInt from memory with no bounds checks
+*
+*	Loads 8 bytes as one little endian word, the first byte without its high bit set ends the varint so
+*	the length is a count of trailing zeros.  The 7 bit groups are then packed together, with BMI2 that is
+*	a single pext otherwise three shift/mask steps (8x7 -> 4x14 -> 2x28 -> 56 bits).
+*
+*********************************************************************************************/
+size_t ReaderWriter::ReadVarInt64Helper(const uint8_t* source, uint64_t &value, size_t maxBytes) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	uint64_t result = 0;
+	for(size_t i = 0; i < maxBytes; ++i) {
+		result |= static_cast<uint64_t>(source[i] & 0x7F) << (7 * i);
+		if(!(source[i] & 0x80)) {
+			value = result;
+			return i + 1;
+		}
+	}
+	return 0;
+#else
+	uint64_t word;
+	memcpy(&word, source, sizeof(word));
+	uint64_t stops = ~word & 0x8080808080808080ULL;
+	size_t length = 9;
+	if(stops) {
+#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long bit;
+		_BitScanForward64(&bit, stops);
+		length = (bit >> 3) + 1;
+#else
+		length = (static_cast<size_t>(__builtin_ctzll(stops)) >> 3) + 1;
+#endif
+		if(length > maxBytes) {
+			return 0;
+		}
+		if(length < sizeof(word)) {
+			word &= (static_cast<uint64_t>(1) << (length * 8)) - 1;
+		}
+	} else if(maxBytes <= sizeof(word)) {
+		return 0;
+	}
+#if defined(__BMI2__)
+	uint64_t result = _pext_u64(word, 0x7F7F7F7F7F7F7F7FULL);
+#else
+	word &= 0x7F7F7F7F7F7F7F7FULL;
+	word = ((word & 0x7F007F007F007F00ULL) >> 1) | (word & 0x007F007F007F007FULL);
+	word = ((word & 0x3FFF00003FFF0000ULL) >> 2) | (word & 0x00003FFF00003FFFULL);
+	uint64_t result = ((word & 0x0FFFFFFF00000000ULL) >> 4) | (word & 0x000000000FFFFFFFULL);
+#endif
+	if(length > sizeof(word)) {
+		//9 or 10 byte varint, only 64 bit values get here
+		result |= static_cast<uint64_t>(source[8] & 0x7F) << 56;
+		if(source[8] & 0x80) {
+			if(source[9] & 0x80) {
+				return 0;
+			}
+			result |= static_cast<uint64_t>(source[9] & 0x7F) << 63;
+			length = 10;
+		}
+	}
+	value = result;
+	return length;
+#endif
+}
+
 /**********************************************************************************************
 *
 * ReaderWriter::WriteVarInt32Helper -- Helper for writing 32-bit VarInts
@@ -424,48 +997,51 @@ size_t ReaderWriter::WriteVarInt64Helper(uint64_t value, uint8_t* target) {
 			if (part0 < (1 << 14)) {
 				if (part0 < (1 << 7)) {
 					size = 1;
-					target[0] = static_cast<uint8_t>((part0      ) | 0x80);
 				} else {
 					size = 2;
-					target[1] = static_cast<uint8_t>((part0 >>  7) | 0x80);
 				}
 			} else {
 				if (part0 < (1 << 21)) {
 					size = 3;
-					target[2] = static_cast<uint8_t>((part0 >> 14) | 0x80);
 				} else {
 					size = 4;
-					target[3] = static_cast<uint8_t>((part0 >> 21) | 0x80);
 				}
 			}
 		} else {
 			if (part1 < (1 << 14)) {
 				if (part1 < (1 << 7)) {
 					size = 5;
-					target[4] = static_cast<uint8_t>((part1      ) | 0x80);
 				} else {
 					size = 6;
-					target[5] = static_cast<uint8_t>((part1 >>  7) | 0x80);
 				}
 			} else {
 				if (part1 < (1 << 21)) {
 					size = 7;
-					target[6] = static_cast<uint8_t>((part1 >> 14) | 0x80);
 				} else {
 					size = 8;
-					target[7] = static_cast<uint8_t>((part1 >> 21) | 0x80);
 				}
 			}
 		}
 	} else {
 		if (part2 < (1 << 7)) {
 			size = 9;
-			target[8] = static_cast<uint8_t>((part2      ) | 0x80);
 		} else {
 			size = 10;
-			target[9] = static_cast<uint8_t>((part2 >>  7) | 0x80);
 		}
 	}
+	//the tree above only picks the size, fill in every byte from the top down
+	switch (size) {
+		case 10: target[9] = static_cast<uint8_t>((part2 >>  7) | 0x80);	//fall through
+		case 9 : target[8] = static_cast<uint8_t>((part2      ) | 0x80);	//fall through
+		case 8 : target[7] = static_cast<uint8_t>((part1 >> 21) | 0x80);	//fall through
+		case 7 : target[6] = static_cast<uint8_t>((part1 >> 14) | 0x80);	//fall through
+		case 6 : target[5] = static_cast<uint8_t>((part1 >>  7) | 0x80);	//fall through
+		case 5 : target[4] = static_cast<uint8_t>((part1      ) | 0x80);	//fall through
+		case 4 : target[3] = static_cast<uint8_t>((part0 >> 21) | 0x80);	//fall through
+		case 3 : target[2] = static_cast<uint8_t>((part0 >> 14) | 0x80);	//fall through
+		case 2 : target[1] = static_cast<uint8_t>((part0 >>  7) | 0x80);	//fall through
+		case 1 : target[0] = static_cast<uint8_t>((part0      ) | 0x80);
+	}
 	target[size-1] &= 0x7F;
 	return size;
 }
@@ -2,6 +2,7 @@
 #define WSS_READERWRITER_H
 
 #include "ireaderwriter.h"
+#include <cstring>
 
 namespace wss {
 	class ReaderWriter {
@@ -12,20 +13,54 @@ namespace wss {
 			BEGIN
 		};
 
-		typedef int32_t pos_type;
+		typedef int64_t pos_type;
 		static const size_t STREAM_ERROR = static_cast<size_t>(-1);
 	public:
 		static IReaderWriter * Create_Default_Interface();
+		//segmented stream with blocks sized by policy, i.e. large or adaptive blocks for bulk transfer
+		static IReaderWriter * Create_Default_Interface(const BlockSizePolicy &policy);
+		//bounded stream backed by a single ring of at least capacity bytes (rounded up to a power of 2)
+		static IReaderWriter * Create_Ring_Interface(size_t capacity);
+		//stream over a memory mapped file, read only or growable read/write, null on failure (see et)
+		static IReaderWriter * Create_Mapped_Interface(const char *fileName, bool writable, ErrorType &et);
+		//lock free queue between two threads:  producer is written by one (i.e. the I/O thread), consumer is read and
+		//consumed by the other.  Wrap each in its own ReaderWriter on its own thread.  maxQueued>0 bounds unconsumed bytes
+		static void Create_SPSC_Interfaces(IReaderWriter *&producer, IReaderWriter *&consumer, size_t maxQueued = 0);
 
 		ReaderWriter(IReaderWriter * stream_interface);
+		//copies share the stream, each copy has its own cursors.  Use snapshot for a copy of the bytes
 		ReaderWriter(const ReaderWriter& other);
+		ReaderWriter &operator=(const ReaderWriter& other);
+		//out is pointed at a new stream holding what this one holds now, with the same cursors.  Segmented streams
+		//share their blocks copy on write so this is cheap and out can be read on another thread while this is written
+		void snapshot(ReaderWriter &out) const;
 
 		~ReaderWriter();
 
 		size_t read(void * dst, size_t length);
 		size_t readUntilDelim(void * dst, size_t length, char delim, bool &wasDelimHit);
+		//index of the first delim at or after pos, STREAM_ERROR if there isn't one.  Nothing is copied
+		size_t findDelim(size_t pos, char delim) const;
 		size_t write(const void * src, size_t length);
+		//zero copy write: fill the memory returned by prepare then commit what was used
+		void * prepare(size_t length, size_t& out_length);
+		size_t commit(size_t length);
+		//insert length bytes in front of the stream (i.e. a length header for what was just written), cursors keep
+		//pointing at the same bytes except a read cursor at the front, which stays there.  0 if the stream can't
+		size_t prepend(const void * src, size_t length);
+		//keep bytes free in front of the data whenever the stream is empty so prepend doesn't need new memory,
+		//segmented streams only
+		void reserveHeadroom(uint32_t bytes);
+		//append a payload shared with other streams, zero copy if the stream supports it
+		size_t writeShared(const SharedBuffer &sb);
 		size_t erase(size_t idx, size_t length);
+		//erase length bytes from the front of the stream
+		size_t consume(size_t length);
+		//move length bytes at idx to the end of dst and erase them here, whole blocks are handed over rather
+		//than copied when both streams are segmented.  dst's write cursor follows if it was at the end
+		size_t splice(ReaderWriter &dst, size_t idx, size_t length);
+		//give back memory the stream holds beyond what its data needs (i.e. an idle connection)
+		void shrinkToFit();
 
 		size_t tellRead() const;
 		size_t seekRead(pos_type distance, StreamSeekType seek_type);
@@ -36,30 +71,36 @@ namespace wss {
 
 		bool empty() const;
 		size_t size() const;
+		size_t capacity() const;
+		bool fixedCapacity() const;
 		size_t getPreferredBlockSize() const;
 
 		//Get raw pointer to data and the maximum contiguous length for a given index
 		const void * raw(size_t idx, size_t& out_length) const;
+		//Get a scatter/gather list of raw pointers covering length bytes from idx
+		size_t rawSpans(size_t idx, size_t length, ConstBufferSpan *spans, size_t maxSpans) const;
 
 		// Type safe methods
 		static_assert(sizeof(float)==4, "Float wrong size" );
 		static_assert(sizeof(double)==8, "DoubleWrongSize" );
 
-		size_t writeFixed8(uint8_t val)  { return write(&val, sizeof(val)); }
-		size_t writeFixed32(int32_t val) { return write(&val, sizeof(val)); }
-		size_t writeFixed32(uint32_t val) { return write(&val, sizeof(val)); }
-		size_t writeFixed32(float val) { return write(&val, sizeof(val)); }
-		size_t writeFixed64(int64_t val) { return write(&val, sizeof(val)); }
-		size_t writeFixed64(uint64_t val) { return write(&val, sizeof(val)); }
-		size_t writeFixed64(double val) { return write(&val, sizeof(val)); }
-
-		size_t readFixed8(uint8_t& val) { return read(&val, sizeof(val)); }
-		size_t readFixed32(int32_t& val) { return read(&val, sizeof(val)); }
-		size_t readFixed32(uint32_t& val) { return read(&val, sizeof(val)); }
-		size_t readFixed32(float& val) { return read(&val, sizeof(val)); }
-		size_t readFixed64(int64_t& val) { return read(&val, sizeof(val)); }
-		size_t readFixed64(uint64_t& val) { return read(&val, sizeof(val)); }
-		size_t readFixed64(double& val) { return read(&val, sizeof(val)); }
+		// fixed width values are a memcpy and cursor bump while they fit in the cached read / write window.
+		// On a fixed capacity stream a write is all or nothing, 0 if the value doesn't fit
+		size_t writeFixed8(uint8_t val)  { return writeFixed(&val, sizeof(val)); }
+		size_t writeFixed32(int32_t val) { return writeFixed(&val, sizeof(val)); }
+		size_t writeFixed32(uint32_t val) { return writeFixed(&val, sizeof(val)); }
+		size_t writeFixed32(float val) { return writeFixed(&val, sizeof(val)); }
+		size_t writeFixed64(int64_t val) { return writeFixed(&val, sizeof(val)); }
+		size_t writeFixed64(uint64_t val) { return writeFixed(&val, sizeof(val)); }
+		size_t writeFixed64(double val) { return writeFixed(&val, sizeof(val)); }
+
+		size_t readFixed8(uint8_t& val) { return readFixed(&val, sizeof(val)); }
+		size_t readFixed32(int32_t& val) { return readFixed(&val, sizeof(val)); }
+		size_t readFixed32(uint32_t& val) { return readFixed(&val, sizeof(val)); }
+		size_t readFixed32(float& val) { return readFixed(&val, sizeof(val)); }
+		size_t readFixed64(int64_t& val) { return readFixed(&val, sizeof(val)); }
+		size_t readFixed64(uint64_t& val) { return readFixed(&val, sizeof(val)); }
+		size_t readFixed64(double& val) { return readFixed(&val, sizeof(val)); }
 
 		// VarInt support
 		static const size_t MaxVarInt32 = sizeof(uint32_t) + 1;
@@ -87,21 +128,99 @@ namespace wss {
 		size_t writeVarSInt32(int32_t val) { return writeVarUInt32(zigZagEncode32(val)); }
 		size_t writeVarSInt64(int64_t val) { return writeVarUInt64(zigZagEncode64(val)); }
 
+		// Bulk VarInt support, decodes straight out of raw() / encodes straight into prepare() memory
+		// reads return the number of values read, stopping (with the read cursor before it) at a truncated or bad varint
+		// writes return the number of values written, a fixed capacity stream never gets a partial varint
+		size_t readVarUInt32Array(uint32_t *vals, size_t count) { return readVarIntArray(vals, count); }
+		size_t readVarSInt32Array(int32_t *vals, size_t count) { return readVarIntArray(vals, count); }
+		size_t readVarUInt64Array(uint64_t *vals, size_t count) { return readVarIntArray(vals, count); }
+		size_t readVarSInt64Array(int64_t *vals, size_t count) { return readVarIntArray(vals, count); }
+
+		size_t writeVarUInt32Array(const uint32_t *vals, size_t count) { return writeVarIntArray(vals, count); }
+		size_t writeVarSInt32Array(const int32_t *vals, size_t count) { return writeVarIntArray(vals, count); }
+		size_t writeVarUInt64Array(const uint64_t *vals, size_t count) { return writeVarIntArray(vals, count); }
+		size_t writeVarSInt64Array(const int64_t *vals, size_t count) { return writeVarIntArray(vals, count); }
+
 	private:
+		//Fixed width fast path.  The read window is the span raw() gave back for the read cursor, the write
+		//window is the rest of the memory prepare() gave back at the end of the stream.  Bytes written to the
+		//write window are committed lazily, by the next call into Impl from any ReaderWriter on the stream,
+		//or straight away when Impl asks for EagerCommit
+		size_t readFixed(void * dst, size_t length) {
+			if(ReadWindowGeneration == Impl->Generation && ReadCursor >= ReadWindowPos
+				&& ReadCursor - ReadWindowPos + length <= ReadWindowLength) {
+				memcpy(dst, ReadWindow + (ReadCursor - ReadWindowPos), length);
+				ReadCursor += length;
+				return length;
+			}
+			return readFixedSlow(dst, length);
+		}
+
+		size_t writeFixed(const void * src, size_t length) {
+			if(WriteWindowGeneration == Impl->Generation && WriteCursor == WriteWindowPos
+				&& length <= static_cast<size_t>(WriteWindowEnd - WriteWindow)) {
+				memcpy(WriteWindow, src, length);
+				WriteWindow += length;
+				WriteWindowPos += length;
+				WriteWindowPending += length;
+				WriteCursor += length;
+				if(Impl->EagerCommit) {
+					commitWriteWindow();
+				} else {
+					Impl->WindowOwner = this;
+				}
+				return length;
+			}
+			return writeFixedSlow(src, length);
+		}
 
-		static uint32_t zigZagEncode32(int32_t n) { return static_cast<uint32_t>((n << 1) ^ (n >> 31)); }
-		static uint64_t zigZagEncode64(int64_t n) { return static_cast<uint64_t>((n << 1) ^ (n >> 63)); }
+		size_t readFixedSlow(void * dst, size_t length);
+		size_t writeFixedSlow(const void * src, size_t length);
+		//commit whatever any ReaderWriter on this stream has left in its write window
+		void syncWindows() const;
+		void commitWriteWindow() const;
+		void resetWindows();
+
+		static uint32_t zigZagEncode32(int32_t n) { return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31); }
+		static uint64_t zigZagEncode64(int64_t n) { return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63); }
 
 		static int32_t zigZagDecode32(uint32_t n) { return static_cast<int32_t>((n >> 1) ^ -(n & 1)); }
 		static int64_t zigZagDecode64(uint64_t n) { return static_cast<int64_t>((n >> 1) ^ -(n & 1)); }
 
+		//wire value <-> array element, signed types are zig zag encoded
+		static uint64_t toVarInt(uint32_t v) { return v; }
+		static uint64_t toVarInt(int32_t v) { return zigZagEncode32(v); }
+		static uint64_t toVarInt(uint64_t v) { return v; }
+		static uint64_t toVarInt(int64_t v) { return zigZagEncode64(v); }
+		static void fromVarInt(uint64_t n, uint32_t &v) { v = static_cast<uint32_t>(n); }
+		static void fromVarInt(uint64_t n, int32_t &v) { v = zigZagDecode32(static_cast<uint32_t>(n)); }
+		static void fromVarInt(uint64_t n, uint64_t &v) { v = n; }
+		static void fromVarInt(uint64_t n, int64_t &v) { v = zigZagDecode64(n); }
+
+		template<typename T> size_t readVarIntArray(T *vals, size_t count);
+		template<typename T> size_t writeVarIntArray(const T *vals, size_t count);
+
+		void moveCursorsForErase(size_t idx, size_t erased_length);
+
 		static size_t WriteVarInt32Helper(uint32_t value, uint8_t* target);
 		static size_t WriteVarInt64Helper(uint64_t value, uint8_t* target);
+		//decodes one varint of at most maxBytes, MaxVarInt64 bytes must be readable at source. 0 if malformed
+		static size_t ReadVarInt64Helper(const uint8_t* source, uint64_t &value, size_t maxBytes);
 
 		size_t ReadCursor;
 		size_t WriteCursor;
 
 		std::shared_ptr<IReaderWriter> Impl;
+
+		const uint8_t *ReadWindow;
+		size_t ReadWindowPos;			//stream index of ReadWindow[0]
+		size_t ReadWindowLength;
+		uint64_t ReadWindowGeneration;
+		uint8_t *WriteWindow;			//where the next fixed width write goes
+		uint8_t *WriteWindowEnd;
+		size_t WriteWindowPos;			//stream index of WriteWindow
+		mutable size_t WriteWindowPending;	//written to the window but not committed
+		uint64_t WriteWindowGeneration;
 	};
 }
 